@@ -0,0 +1,55 @@
+#!/bin/sh
+# Boot the benchmark entry headless and print its BENCH lines:
+#
+#   ./bench.sh [-b baseline] [benchmark,...] > results
+#
+# With -b, each figure is printed next to the baseline's and the change.
+set -e
+
+BASELINE=
+if [ "$1" = "-b" ]; then
+  BASELINE=$2
+  shift 2
+fi
+
+BENCH=${1:-1}
+export BENCH
+. ./iso.sh > /dev/null 2>&1
+
+LOG=$(mktemp)
+trap 'rm -f "$LOG"' EXIT
+
+# isa-debug-exit turns the kernel's qemu_exit(0) into exit status 1
+STATUS=0
+timeout 300 qemu-system-$(./target-triplet-to-arch.sh $HOST) -cdrom chimpos.iso \
+  -display none -serial stdio -no-reboot \
+  -device isa-debug-exit,iobase=0xf4,iosize=0x04 > "$LOG" || STATUS=$?
+
+if [ "$STATUS" -ne 1 ]; then
+  cat "$LOG" >&2
+  echo "bench.sh: the kernel did not finish (exit status $STATUS)" >&2
+  exit 1
+fi
+
+# serial lines are "[seconds] message", keep "BENCH name value unit"
+RESULTS=$(sed -n 's/^.*\(BENCH [^ ]* [0-9]* .*\)$/\1/p' "$LOG" | tr -d '\r')
+
+if [ -z "$BASELINE" ]; then
+  echo "$RESULTS"
+  exit 0
+fi
+
+echo "$RESULTS" | awk -v baseline="$BASELINE" '
+  BEGIN {
+    while ((getline line < baseline) > 0) {
+      split(line, f, " ")
+      if (f[1] == "BENCH")
+        old[f[2]] = f[3]
+    }
+  }
+  {
+    if ($2 in old && old[$2] > 0)
+      printf "%-24s %12s %12s %-12s %+7.1f%%\n", $2, old[$2], $3, $4, ($3 - old[$2]) * 100 / old[$2]
+    else
+      printf "%-24s %12s %12s %s\n", $2, "-", $3, $4
+  }'
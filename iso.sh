@@ -6,10 +6,37 @@ mkdir -p isodir
 mkdir -p isodir/boot
 mkdir -p isodir/boot/grub
 
+# BENCH=1 (or a list of benchmark names, BENCH=memcpy,tty) boots straight
+# into the benchmark entry, see bench.sh
+if [ -n "$BENCH" ]; then
+  if [ "$BENCH" = 1 ]; then BENCH_ARGS=bench; else BENCH_ARGS="bench=$BENCH"; fi
+  MENU_DEFAULT="set default=1
+set timeout=0"
+else
+  BENCH_ARGS=bench
+  MENU_DEFAULT=
+fi
+
 cp sysroot/boot/chimpos.kernel isodir/boot/chimpos.kernel
+
+# initrd/ and the programs built from user/ go in as a ustar archive,
+# the first multiboot module
+INITRD=$(mktemp -d)
+cp -R initrd/. "$INITRD"
+$CC -nostdlib -static -Wl,-Ttext=0x08048000 -o "$INITRD/init" user/init.S
+tar --format=ustar -cf isodir/boot/initrd.tar -C "$INITRD" .
+rm -rf "$INITRD"
+
 cat > isodir/boot/grub/grub.cfg << EOF
+insmod all_video
+$MENU_DEFAULT
 menuentry "chimp-os" {
 	multiboot /boot/chimpos.kernel
+	module /boot/initrd.tar initrd
+}
+menuentry "chimp-os (benchmarks)" {
+	multiboot /boot/chimpos.kernel $BENCH_ARGS
+	module /boot/initrd.tar initrd
 }
 EOF
 grub-mkrescue -o chimpos.iso isodir
@@ -0,0 +1,104 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <kernel/clock.h>
+#include <kernel/pit.h>
+#include <kernel/system.h>
+#include <kernel/printk.h>
+
+/* Channel 2 counts this long while the TSC is measured */
+#define CALIBRATE_MS    50
+#define CALIBRATE_COUNT (PIT_HZ * CALIBRATE_MS / 1000)
+
+static uint32_t clock_mult = 0;
+static uint32_t clock_shift = 0;
+static uint64_t clock_base = 0;     /* TSC at clock_init() */
+static uint32_t tsc_khz = 0;
+
+uint64_t clock_cycles_to_ns(uint64_t cycles)
+{
+    uint32_t hi = cycles >> 32;
+    uint32_t lo = cycles;
+
+    return (((uint64_t) hi * clock_mult) << (32 - clock_shift)) +
+           (((uint64_t) lo * clock_mult) >> clock_shift);
+}
+
+uint64_t clock_monotonic_ns()
+{
+    if (!clock_mult)
+        return pit_clock_ns();
+    return clock_cycles_to_ns(rdtsc() - clock_base);
+}
+
+uint32_t clock_tsc_khz()
+{
+    return tsc_khz;
+}
+
+/* TSC cycles while PIT channel 2 counts CALIBRATE_COUNT down in mode 0 */
+static uint64_t tsc_measure()
+{
+    unsigned int flags = irq_save();
+    unsigned char gate = inportb(PIT_GATE);
+
+    /* gate channel 2 on, keep the speaker off */
+    outportb(PIT_GATE, (gate & ~PIT_GATE_SPEAKER) | PIT_GATE_CH2);
+    outportb(PIT_COMMAND, PIT_ONESHOT_CH2);
+    outportb(PIT_CHANNEL2, CALIBRATE_COUNT & 0xFF);
+    outportb(PIT_CHANNEL2, CALIBRATE_COUNT >> 8);
+
+    uint64_t start = rdtsc();
+    while (!(inportb(PIT_GATE) & PIT_GATE_OUT2))
+        ;
+    uint64_t end = rdtsc();
+
+    outportb(PIT_GATE, gate);
+    irq_restore(flags);
+    return end - start;
+}
+
+/*
+ * Pick the largest shift that keeps mult in 32 bits, mult being
+ * 10^6 * 2^shift / khz, for the most precise conversion.
+ */
+static void clock_set_rate(uint32_t khz)
+{
+    uint32_t shift = 32;
+
+    while (shift && ((1000000ull << shift) / khz) >> 32)
+        shift--;
+
+    clock_shift = shift;
+    clock_mult = (1000000ull << shift) / khz;
+}
+
+void clock_init()
+{
+    unsigned int eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_FEAT_EDX_TSC))
+    {
+        printk(LOG_WARNING, "clock: no TSC, using the PIT\n");
+        return;
+    }
+
+    uint64_t cycles = tsc_measure();
+    tsc_khz = cycles / CALIBRATE_MS;
+    if (!tsc_khz)
+    {
+        printk(LOG_WARNING, "clock: TSC did not count, using the PIT\n");
+        return;
+    }
+
+    clock_set_rate(tsc_khz);
+    clock_base = rdtsc();
+
+    /* what a timestamp costs */
+    uint64_t start = rdtsc();
+    for (int i = 0; i < 1000; i++)
+        clock_monotonic_ns();
+    unsigned int cost = (rdtsc() - start) / 1000;
+
+    printk(LOG_INFO, "clock: TSC at %u kHz, clock_monotonic_ns() takes %u cycles\n", tsc_khz, cost);
+}
@@ -0,0 +1,189 @@
+#include <stdint.h>
+#include <string.h>
+#include <slab.h>
+
+#include <kernel/elf.h>
+#include <kernel/process.h>
+#include <kernel/sched.h>
+#include <kernel/syscall.h>
+#include <kernel/pmm.h>
+#include <kernel/vmm.h>
+#include <kernel/system.h>
+#include <kernel/printk.h>
+#include <kernel/bench.h>
+
+static int elf_check(const struct elf32_header *h, size_t size)
+{
+    if (size < sizeof(*h) || h->magic != ELF_MAGIC || h->class != ELFCLASS32 ||
+        h->data != ELFDATA2LSB || h->version != EV_CURRENT)
+        return -1;
+    if (h->type != ET_EXEC || h->machine != EM_386)
+        return -1;
+    if (h->phentsize != sizeof(struct elf32_program_header) || h->phoff > size ||
+        h->phnum > (size - h->phoff) / sizeof(struct elf32_program_header))
+        return -1;
+    return 0;
+}
+
+int elf_load(struct process *p, const void *image, size_t size, uint32_t *entry)
+{
+    const struct elf32_header *h = image;
+
+    if (elf_check(h, size))
+        return -1;
+
+    const struct elf32_program_header *ph = (const void *) ((const uint8_t *) image + h->phoff);
+    for (unsigned int i = 0; i < h->phnum; i++, ph++)
+    {
+        if (ph->type != PT_LOAD || !ph->memsz)
+            continue;
+
+        /* the area starts on the page boundary below vaddr, so does its file data */
+        uint32_t pad = ph->vaddr & (PAGE_SIZE - 1);
+        if (ph->filesz > ph->memsz || ph->offset > size || ph->filesz > size - ph->offset ||
+            ph->offset < pad || ph->vaddr >= KERNEL_VIRTUAL_BASE ||
+            ph->memsz > KERNEL_VIRTUAL_BASE - ph->vaddr)
+            return -1;
+
+        uint32_t start = ph->vaddr - pad;
+        uint32_t end = (ph->vaddr + ph->memsz + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        uint32_t flags = VMM_USER | ((ph->flags & PF_W) ? VMM_WRITE : 0);
+
+        if (process_map(p, start, end, flags, (const uint8_t *) image + ph->offset - pad,
+                        ph->filesz + pad))
+            return -1;
+    }
+
+    *entry = h->entry;
+    return 0;
+}
+
+struct elf_exec_args
+{
+    const void *image;
+    size_t size;
+};
+
+static void elf_exec_setup(void *arg)
+{
+    struct elf_exec_args args = *(struct elf_exec_args *) arg;
+    struct process *p = process_current();
+    uint32_t entry;
+
+    kfree(arg);
+    if (elf_load(p, args.image, args.size, &entry) ||
+        process_map(p, USER_STACK_TOP - USER_STACK_MAX, USER_STACK_TOP, VMM_USER | VMM_WRITE, 0, 0))
+        return;
+
+    /* System V initial stack: argc 0, empty argv and envp, no auxiliary vector */
+    uint32_t *sp = (uint32_t *) USER_STACK_TOP - 5;
+    memset(sp, 0, 5 * sizeof(uint32_t));
+    enter_user(entry, (uint32_t) sp);
+}
+
+int elf_exec(const char *name, const void *image, size_t size)
+{
+    struct elf_exec_args *args = kmalloc(sizeof(*args));
+    if (!args)
+        return -1;
+    args->image = image;
+    args->size = size;
+
+    int pid = process_create(name, elf_exec_setup, args);
+    if (pid < 0)
+        kfree(args);
+    return pid;
+}
+
+/* ======== Benchmark ======== */
+
+#define ELF_BENCH_ROUNDS 8
+
+#define ELF_BENCH_TEXT  0x08048000
+#define ELF_BENCH_BSS   0x10000
+
+/* lives in boot.S, position independent */
+extern char elf_bench_user[];
+extern char elf_bench_user_end[];
+
+/*
+ * An executable of 2^order pages: headers, a page of text, the rest
+ * data, then some bss. The program reads one data page and exits.
+ */
+static uint8_t *elf_bench_image(unsigned int order, size_t *size)
+{
+    uint8_t *image = kpage_alloc(order);
+    if (!image)
+        return 0;
+
+    *size = PAGE_SIZE << order;
+    uint32_t data_size = *size - 2 * PAGE_SIZE;
+    uint32_t code_size = elf_bench_user_end - elf_bench_user;
+
+    /* touches every heap page now, not while the benchmark runs */
+    memset(image, 0x5A, *size);
+    memset(image, 0, PAGE_SIZE);
+    memcpy(image + PAGE_SIZE, elf_bench_user, code_size);
+
+    struct elf32_header *h = (struct elf32_header *) image;
+    h->magic = ELF_MAGIC;
+    h->class = ELFCLASS32;
+    h->data = ELFDATA2LSB;
+    h->ident_version = EV_CURRENT;
+    h->type = ET_EXEC;
+    h->machine = EM_386;
+    h->version = EV_CURRENT;
+    h->entry = ELF_BENCH_TEXT + PAGE_SIZE;
+    h->phoff = sizeof(*h);
+    h->ehsize = sizeof(*h);
+    h->phentsize = sizeof(struct elf32_program_header);
+    h->phnum = 2;
+
+    struct elf32_program_header *ph = (struct elf32_program_header *) (h + 1);
+    ph[0].type = PT_LOAD;
+    ph[0].offset = 0;
+    ph[0].vaddr = ph[0].paddr = ELF_BENCH_TEXT;
+    ph[0].filesz = ph[0].memsz = PAGE_SIZE + code_size;
+    ph[0].flags = PF_R | PF_X;
+    ph[0].align = PAGE_SIZE;
+
+    ph[1].type = PT_LOAD;
+    ph[1].offset = 2 * PAGE_SIZE;
+    ph[1].vaddr = ph[1].paddr = ELF_BENCH_TEXT + 2 * PAGE_SIZE;
+    ph[1].filesz = data_size;
+    ph[1].memsz = data_size + ELF_BENCH_BSS;
+    ph[1].flags = PF_R | PF_W;
+    ph[1].align = PAGE_SIZE;
+    return image;
+}
+
+/* Cycles from elf_exec to exit, called from the idle thread: it runs again once the process exited */
+static unsigned int elf_bench_run(unsigned int order)
+{
+    size_t size;
+    uint8_t *image = elf_bench_image(order, &size);
+    if (!image)
+        return 0;
+
+    unsigned long long start = rdtsc();
+    for (int i = 0; i < ELF_BENCH_ROUNDS; i++)
+        elf_exec("bench-elf", image, size);
+    unsigned int cost = (rdtsc() - start) / ELF_BENCH_ROUNDS;
+
+    kpage_free(image, order);
+    return cost;
+}
+
+/*
+ * Start and exit of a 16 KiB and a 4 MiB executable that touch the
+ * same three pages. With demand paging both cost about the same.
+ */
+void elf_bench()
+{
+    unsigned int small = elf_bench_run(2);
+    unsigned int large = elf_bench_run(PMM_MAX_ORDER);
+
+    printk(LOG_INFO, "elf: %u cycles to run a 16 KiB executable, %u for 4 MiB\n", small, large);
+    bench_report("elf_exec_16k", small, "cycles");
+    bench_report("elf_exec_4m", large, "cycles");
+}
@@ -0,0 +1,302 @@
+#include <stdint.h>
+#include <string.h>
+#include <slab.h>
+
+#include <kernel/fbcon.h>
+#include <kernel/vmm.h>
+#include <kernel/clock.h>
+#include <kernel/system.h>
+#include <kernel/printk.h>
+#include <kernel/bench.h>
+
+#include "font.h"
+
+#define GLYPH_PIXELS (FBCON_GLYPH_WIDTH * FBCON_GLYPH_HEIGHT)
+
+/* Direct mapped; for any one attribute, all 256 characters fit */
+#define GLYPH_CACHE_SIZE 256
+#define GLYPH_VALID      0x10000
+
+struct glyph
+{
+    uint32_t tag;                       /* cell | GLYPH_VALID, 0 when empty */
+    uint32_t pixels[GLYPH_PIXELS];
+};
+
+static size_t fb_cols, fb_rows;
+static uint8_t *fb;                     /* top left cell on the screen */
+static size_t fb_pitch;                 /* in bytes */
+static unsigned int fb_bytes;           /* per pixel: 2, 3 or 4 */
+static uint32_t *back;                  /* the grid, rendered */
+static size_t back_pitch;               /* in pixels */
+static uint16_t *drawn;                 /* cells as last drawn */
+
+static struct glyph *glyph_cache;
+static uint32_t palette[16];            /* VGA colours in framebuffer format */
+static uint32_t nibble_mask[16][4];     /* 4 font bits -> 4 pixel masks */
+
+/* VGA text mode palette, 0xRRGGBB */
+static const uint32_t vga_rgb[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF,
+};
+
+static uint32_t pack_channel(uint32_t value, uint8_t pos, uint8_t size)
+{
+    return size > 8 ? value << (pos + size - 8) : (value >> (8 - size)) << pos;
+}
+
+/* Copy 'count' back buffer pixels out in the framebuffer's pixel size */
+static void fb_write(uint8_t *dst, const uint32_t *src, size_t count)
+{
+    switch (fb_bytes)
+    {
+    case 4:
+        copy_dwords(dst, src, count);
+        break;
+    case 3:
+        for (size_t i = 0; i < count; i++, dst += 3)
+        {
+            dst[0] = src[i];
+            dst[1] = src[i] >> 8;
+            dst[2] = src[i] >> 16;
+        }
+        break;
+    default:
+        for (size_t i = 0; i < count; i++)
+            ((uint16_t *) dst)[i] = src[i];
+        break;
+    }
+}
+
+static const uint8_t *font_glyph(unsigned char c)
+{
+    if (c < FONT_FIRST || c > FONT_LAST)
+        c = ' ';
+    return font8x8[c - FONT_FIRST];
+}
+
+/* Font rows to pixels with two mask lookups per row, no per-bit branches */
+static void glyph_expand(uint32_t *dst, size_t pitch, uint16_t cell)
+{
+    const uint8_t *bits = font_glyph(cell & 0xFF);
+    uint32_t bg = palette[cell >> 12];
+    uint32_t diff = palette[(cell >> 8) & 0xF] ^ bg;
+
+    for (int y = 0; y < FBCON_GLYPH_HEIGHT; y++)
+    {
+        uint8_t row = bits[y / 2];
+        const uint32_t *lo = nibble_mask[row & 0xF];
+        const uint32_t *hi = nibble_mask[row >> 4];
+
+        for (int x = 0; x < 4; x++)
+        {
+            dst[x] = bg ^ (lo[x] & diff);
+            dst[x + 4] = bg ^ (hi[x] & diff);
+        }
+        dst += pitch;
+    }
+}
+
+static const uint32_t *glyph_lookup(uint16_t cell)
+{
+    unsigned int ch = cell & 0xFF, attr = cell >> 8;
+    struct glyph *g = &glyph_cache[(ch ^ (attr * 37)) & (GLYPH_CACHE_SIZE - 1)];
+
+    if (g->tag != (cell | GLYPH_VALID))
+    {
+        glyph_expand(g->pixels, FBCON_GLYPH_WIDTH, cell);
+        g->tag = cell | GLYPH_VALID;
+    }
+    return g->pixels;
+}
+
+static void glyph_blit(uint32_t *dst, size_t pitch, const uint32_t *src)
+{
+    for (int y = 0; y < FBCON_GLYPH_HEIGHT; y++)
+    {
+        for (int x = 0; x < FBCON_GLYPH_WIDTH; x++)
+            dst[x] = src[x];
+        dst += pitch;
+        src += FBCON_GLYPH_WIDTH;
+    }
+}
+
+/* Render the cells of row 'y' that changed, then copy out just that span */
+void fbcon_draw_row(size_t y, const uint16_t *cells)
+{
+    uint16_t *old = &drawn[y * fb_cols];
+    uint32_t *line = &back[y * FBCON_GLYPH_HEIGHT * back_pitch];
+    size_t first = fb_cols, last = 0;
+
+    for (size_t x = 0; x < fb_cols; x++)
+    {
+        if (cells[x] == old[x])
+            continue;
+        old[x] = cells[x];
+        glyph_blit(&line[x * FBCON_GLYPH_WIDTH], back_pitch, glyph_lookup(cells[x]));
+        if (first == fb_cols)
+            first = x;
+        last = x + 1;
+    }
+    if (first == fb_cols)
+        return;
+
+    size_t offset = first * FBCON_GLYPH_WIDTH;
+    size_t count = (last - first) * FBCON_GLYPH_WIDTH;
+    uint8_t *screen = &fb[y * FBCON_GLYPH_HEIGHT * fb_pitch + offset * fb_bytes];
+
+    for (int i = 0; i < FBCON_GLYPH_HEIGHT; i++)
+        fb_write(&screen[i * fb_pitch], &line[i * back_pitch + offset], count);
+}
+
+int fbcon_init(struct multiboot_info *mbi, size_t cols, size_t rows)
+{
+    /* text mode: the VGA buffer is what the screen shows */
+    if (!(mbi->flags & MULTIBOOT_INFO_FRAMEBUFFER_INFO)
+        || mbi->framebuffer_type == MULTIBOOT_FRAMEBUFFER_TYPE_EGA_TEXT)
+        return 0;
+
+    size_t width = cols * FBCON_GLYPH_WIDTH;
+    size_t height = rows * FBCON_GLYPH_HEIGHT;
+    unsigned int bpp = mbi->framebuffer_bpp;
+    if (mbi->framebuffer_type != MULTIBOOT_FRAMEBUFFER_TYPE_RGB
+        || (bpp != 16 && bpp != 24 && bpp != 32)
+        || (mbi->framebuffer_addr >> 32)
+        || mbi->framebuffer_width < width || mbi->framebuffer_height < height)
+    {
+        /* the screen is in graphics mode, VGA text memory is not shown */
+        printk(LOG_WARNING, "fbcon: cannot draw on the %ux%u %u bpp framebuffer (type %u), "
+               "the console is on the serial port only\n",
+               mbi->framebuffer_width, mbi->framebuffer_height, bpp, mbi->framebuffer_type);
+        return 0;
+    }
+
+    /* allocate first, so a failure leaves no MMIO window behind */
+    back = kmalloc(width * height * sizeof(uint32_t));
+    drawn = kmalloc(cols * rows * sizeof(uint16_t));
+    glyph_cache = kmalloc(GLYPH_CACHE_SIZE * sizeof(struct glyph));
+    uint8_t *screen = 0;
+    if (back && drawn && glyph_cache)
+        screen = vmm_map_mmio((uint32_t) mbi->framebuffer_addr,
+                              mbi->framebuffer_pitch * mbi->framebuffer_height);
+    if (!screen)
+    {
+        printk(LOG_WARNING, "fbcon: out of memory for the framebuffer console\n");
+        kfree(back);
+        kfree(drawn);
+        kfree(glyph_cache);
+        back = 0;
+        drawn = 0;
+        glyph_cache = 0;
+        return 0;
+    }
+
+    const uint8_t *c = mbi->color_info;
+    for (int i = 0; i < 16; i++)
+    {
+        palette[i] = pack_channel((vga_rgb[i] >> 16) & 0xFF, c[0], c[1])
+                   | pack_channel((vga_rgb[i] >> 8) & 0xFF, c[2], c[3])
+                   | pack_channel(vga_rgb[i] & 0xFF, c[4], c[5]);
+    }
+    for (int n = 0; n < 16; n++)
+        for (int x = 0; x < 4; x++)
+            nibble_mask[n][x] = (n >> x) & 1 ? 0xFFFFFFFF : 0;
+    for (int i = 0; i < GLYPH_CACHE_SIZE; i++)
+        glyph_cache[i].tag = 0;
+
+    /* nothing drawn yet: no cell matches, the first flush draws them all */
+    memset(drawn, 0xFF, cols * rows * sizeof(uint16_t));
+
+    fb_pitch = mbi->framebuffer_pitch;
+    fb_bytes = bpp / 8;
+    for (uint32_t y = 0; y < mbi->framebuffer_height; y++)
+        for (uint32_t x = 0; x < mbi->framebuffer_width; x++)
+            fb_write(&screen[y * fb_pitch + x * fb_bytes], &palette[0], 1);
+
+    fb_cols = cols;
+    fb_rows = rows;
+    back_pitch = width;
+    fb = screen + ((mbi->framebuffer_height - height) / 2) * fb_pitch
+                + (mbi->framebuffer_width - width) / 2 * fb_bytes;
+
+    printk(LOG_INFO, "fbcon: %ux%u %u bpp framebuffer\n",
+           mbi->framebuffer_width, mbi->framebuffer_height, bpp);
+    return 1;
+}
+
+/* ======== Blit benchmark ======== */
+
+#define BLIT_BENCH_GLYPHS 20000
+#define BLIT_BENCH_COPIES 20
+
+/* the cell the bench draws i-th: printable characters in two colour pairs */
+static uint16_t bench_cell(int i)
+{
+    uint16_t attr = (i / 64) & 1 ? 0x1F : 0x07;
+    return (attr << 8) | (FONT_FIRST + i % (FONT_LAST - FONT_FIRST + 1));
+}
+
+/* Straightforward rendering for comparison: test every font bit */
+static void glyph_draw_bits(uint32_t *dst, size_t pitch, uint16_t cell)
+{
+    const uint8_t *bits = font_glyph(cell & 0xFF);
+
+    for (int y = 0; y < FBCON_GLYPH_HEIGHT; y++)
+    {
+        for (int x = 0; x < FBCON_GLYPH_WIDTH; x++)
+            dst[x] = bits[y / 2] & (1 << x) ? palette[(cell >> 8) & 0xF] : palette[cell >> 12];
+        dst += pitch;
+    }
+}
+
+/*
+ * Cycles per glyph drawn into a scratch row of cells by testing each font
+ * bit, by mask expansion (a glyph cache miss) and from the glyph cache,
+ * then the rate at which the back buffer goes out to the framebuffer.
+ */
+void fbcon_blit_bench(void)
+{
+    if (!fb)
+        return;
+
+    uint32_t *row = kmalloc(back_pitch * FBCON_GLYPH_HEIGHT * sizeof(uint32_t));
+    if (!row)
+        return;
+
+    unsigned long long start = rdtsc();
+    for (int i = 0; i < BLIT_BENCH_GLYPHS; i++)
+        glyph_draw_bits(&row[(i % fb_cols) * FBCON_GLYPH_WIDTH], back_pitch, bench_cell(i));
+    unsigned int bits = (rdtsc() - start) / BLIT_BENCH_GLYPHS;
+
+    start = rdtsc();
+    for (int i = 0; i < BLIT_BENCH_GLYPHS; i++)
+        glyph_expand(&row[(i % fb_cols) * FBCON_GLYPH_WIDTH], back_pitch, bench_cell(i));
+    unsigned int expand = (rdtsc() - start) / BLIT_BENCH_GLYPHS;
+
+    start = rdtsc();
+    for (int i = 0; i < BLIT_BENCH_GLYPHS; i++)
+        glyph_blit(&row[(i % fb_cols) * FBCON_GLYPH_WIDTH], back_pitch, glyph_lookup(bench_cell(i)));
+    unsigned int cached = (rdtsc() - start) / BLIT_BENCH_GLYPHS;
+
+    kfree(row);
+
+    /* the screen already shows the back buffer, copying it again changes nothing */
+    size_t lines = fb_rows * FBCON_GLYPH_HEIGHT;
+    start = rdtsc();
+    for (int n = 0; n < BLIT_BENCH_COPIES; n++)
+        for (size_t i = 0; i < lines; i++)
+            fb_write(&fb[i * fb_pitch], &back[i * back_pitch], back_pitch);
+    unsigned long long cycles = rdtsc() - start;
+    unsigned long long bytes = (unsigned long long) BLIT_BENCH_COPIES * lines * back_pitch * fb_bytes;
+    unsigned int mbps = cycles ? bytes * clock_tsc_khz() / cycles / 1000 : 0;
+    unsigned int glyphs = cached ? clock_tsc_khz() * 1000ull / cached : 0;
+
+    printk(LOG_INFO, "fbcon: cycles/glyph: per-bit %u, expanded %u, cached %u (%u glyphs/s)\n",
+           bits, expand, cached, glyphs);
+    printk(LOG_INFO, "fbcon: framebuffer copy %u MB/s\n", mbps);
+    bench_report("fbcon_glyph_bits", bits, "cycles");
+    bench_report("fbcon_glyph_expand", expand, "cycles");
+    bench_report("fbcon_glyph_cached", cached, "cycles");
+    bench_report("fbcon_copy", mbps, "MB/s");
+}
@@ -1,7 +1,10 @@
+#include <string.h>
+
 #include <kernel/gdt.h>
 
-struct gdt_entry gdt[3];
+struct gdt_entry gdt[GDT_ENTRIES];
 struct gdt_ptr gp;
+struct tss_entry tss;
 
 /* asm routine lives in boot.S */
 extern void gdt_flush();
@@ -26,7 +29,7 @@ void gdt_set_gate(int num, unsigned long base, unsigned long limit, unsigned cha
 void gdt_install()
 {
     /* GDT ptr*/
-    gp.limit = (sizeof(struct gdt_entry) * 3) - 1;
+    gp.limit = (sizeof(struct gdt_entry) * GDT_ENTRIES) - 1;
     gp.base = (unsigned int) &gdt;
 
     /* NULL descriptor */
@@ -43,6 +46,17 @@ void gdt_install()
     *  this entry's access byte says it's a Data Segment */
     gdt_set_gate(2, 0, 0xFFFFFFFF, 0x92, 0xCF);
 
+    /* The same two for ring 3, DPL 3 in the access byte */
+    gdt_set_gate(3, 0, 0xFFFFFFFF, 0xFA, 0xCF);
+    gdt_set_gate(4, 0, 0xFFFFFFFF, 0xF2, 0xCF);
+
+    /* A 32-bit TSS, esp0 is filled in by the scheduler */
+    memset(&tss, 0, sizeof(tss));
+    tss.ss0 = GDT_KERNEL_DATA;
+    tss.iomap_base = sizeof(tss);
+    gdt_set_gate(5, (unsigned long) &tss, sizeof(tss) - 1, 0x89, 0x00);
+
     /* Flush out the old GDT and install the new */
     gdt_flush();
+    __asm__ __volatile__ ("ltr %w0" : : "r" (GDT_TSS));
 }
@@ -1,5 +1,8 @@
 #include <kernel/isr.h>
-#include <stdio.h>
+#include <kernel/vmm.h>
+#include <kernel/fpu.h>
+#include <kernel/process.h>
+#include <kernel/printk.h>
 
 const char *exception_messages[] =
 {
@@ -112,6 +115,29 @@ void isrs_install()
     idt_set_gate(31, (unsigned)isr31, 0x08, 0x8E);
 }
 
+/* lives in boot.S */
+struct exception_entry
+{
+    uint32_t insn;              /* may fault on a user address */
+    uint32_t fixup;             /* where to resume if it does */
+};
+
+extern const struct exception_entry exception_table[];
+extern const struct exception_entry exception_table_end[];
+
+static int exception_fixup(struct regs *r)
+{
+    for (const struct exception_entry *e = exception_table; e < exception_table_end; e++)
+    {
+        if (r->eip == e->insn)
+        {
+            r->eip = e->fixup;
+            return 1;
+        }
+    }
+    return 0;
+}
+
 /*  
  *  Upon fault, endless loop. 
  *
@@ -122,10 +148,36 @@ void isrs_install()
 
 void fault_handler(struct regs *r)
 {
+    /* No Coprocessor: CR0.TS is set, the FPU goes to whoever asked for it */
+    if (r->int_no == 7)
+    {
+        fpu_trap();
+        return;
+    }
+
+    /* Page Fault: lazily allocated pages are filled in by the VMM, the
+     * pages of a process's areas by the process */
+    if (r->int_no == 14 && (vmm_page_fault(read_cr2(), r->err_code) ||
+                            process_page_fault(read_cr2(), r->err_code)))
+        return;
+
+    /* A user copy hit an address nothing backs: its caller gets an error */
+    if (r->int_no == 14 && !(r->cs & 3) && exception_fixup(r))
+        return;
+
+    /* From ring 3, only the process goes down */
+    if (r->int_no < 32 && (r->cs & 3) && process_current())
+    {
+        struct process *p = process_current();
+        printk(LOG_ERR, "process %u (%s): %s Exception at %#x, killed\n",
+               p->pid, p->name, exception_messages[r->int_no], r->eip);
+        process_exit(-1);
+    }
+
     if (r->int_no < 32)
     {
-        puts(exception_messages[r->int_no]);
-        puts(" Exception. System Halted!\n");
+        printk(LOG_EMERG, "%s Exception. System Halted!\n", exception_messages[r->int_no]);
+        console_flush_on_panic();
         for (;;);
     }
 }
@@ -1,7 +1,22 @@
 #include <stdio.h>
+#include <stddef.h>
 #include <kernel/keyboard.h>
 #include <kernel/irq.h>
 #include <kernel/tty.h>
+#include <kernel/ring.h>
+#include <kernel/sched.h>
+#include <kernel/printk.h>
+
+/* Scancodes of the modifier keys, set 1 */
+#define SC_RELEASE  0x80
+#define SC_EXTENDED 0xE0
+#define SC_CTRL     0x1D
+#define SC_LSHIFT   0x2A
+#define SC_RSHIFT   0x36
+#define SC_ALT      0x38
+#define SC_CAPSLOCK 0x3A
+#define SC_PAGEUP   0x49
+#define SC_PAGEDOWN 0x51
 
 unsigned char kbdus[128] =
 {
@@ -43,29 +58,232 @@ unsigned char kbdus[128] =
     0,	/* All other keys are undefined */
 };		
 
+/* Same keys with shift held */
+unsigned char kbdus_shift[128] =
+{
+    0,  27, '!', '@', '#', '$', '%', '^', '&', '*',	/* 9 */
+  '(', ')', '_', '+', '\b',	/* Backspace */
+  '\t',			/* Tab */
+  'Q', 'W', 'E', 'R',	/* 19 */
+  'T', 'Y', 'U', 'I', 'O', 'P', '{', '}', '\n',	/* Enter key */
+    0,			/* 29   - Control */
+  'A', 'S', 'D', 'F', 'G', 'H', 'J', 'K', 'L', ':',	/* 39 */
+  '"', '~',   0,		/* Left shift */
+  '|', 'Z', 'X', 'C', 'V', 'B', 'N',			/* 49 */
+  'M', '<', '>', '?',   0,				/* Right shift */
+  '*',
+    0,	/* Alt */
+  ' ',	/* Space bar */
+    0,	/* Caps lock */
+    0,	/* 59 - F1 key ... > */
+    0,   0,   0,   0,   0,   0,   0,   0,
+    0,	/* < ... F10 */
+    0,	/* 69 - Num lock*/
+    0,	/* Scroll Lock */
+    0,	/* Home key */
+    0,	/* Up Arrow */
+    0,	/* Page Up */
+  '-',
+    0,	/* Left Arrow */
+    0,
+    0,	/* Right Arrow */
+  '+',
+    0,	/* 79 - End key*/
+    0,	/* Down Arrow */
+    0,	/* Page Down */
+    0,	/* Insert Key */
+    0,	/* Delete Key */
+    0,   0,   0,
+    0,	/* F11 Key */
+    0,	/* F12 Key */
+    0,	/* All other keys are undefined */
+};
+
+/*
+ * IRQ1 only queues the raw scancode and raises SOFTIRQ_KEYBOARD, which
+ * tracks the modifiers, decodes, echoes and queues characters for readers.
+ */
+static unsigned char scancode_buf[64];
+static unsigned char input_buf[256];
+
+static struct spsc_ring scancodes = SPSC_RING_INIT(scancode_buf);
+static struct spsc_ring input = SPSC_RING_INIT(input_buf);
+
+static struct wait_queue kbd_readers;
+
+static unsigned int kbd_modifiers = 0;
+static unsigned int kbd_dropped = 0;
+
 /* Handles the keyboard interrupt */
 void keyboard_handler(struct regs *r)
+{
+    (void) r;
+
+    /* Read from kb data buffer, the softirq does the rest */
+    if (!spsc_push(&scancodes, inportb(0x60)))
+        kbd_dropped++;
+    softirq_raise(SOFTIRQ_KEYBOARD);
+}
+
+/* Character for a scancode given the modifiers held, 0 for none */
+static unsigned char kbd_decode(unsigned char scancode)
+{
+    static int extended = 0;
+    int release = scancode & SC_RELEASE;
+    unsigned int mod = 0;
+
+    if (scancode == SC_EXTENDED)
+    {
+        extended = 1;
+        return 0;
+    }
+
+    /* right ctrl, alt and the page keys are the keypad ones behind a prefix */
+    scancode &= ~SC_RELEASE;
+    if (extended)
+    {
+        extended = 0;
+        if (scancode != SC_CTRL && scancode != SC_ALT &&
+            scancode != SC_PAGEUP && scancode != SC_PAGEDOWN)
+            return 0;
+    }
+
+    switch (scancode)
+    {
+    case SC_LSHIFT:
+    case SC_RSHIFT:
+        mod = KBD_SHIFT;
+        break;
+    case SC_CTRL:
+        mod = KBD_CTRL;
+        break;
+    case SC_ALT:
+        mod = KBD_ALT;
+        break;
+    case SC_CAPSLOCK:
+        if (!release)
+            kbd_modifiers ^= KBD_CAPSLOCK;
+        return 0;
+    }
+
+    if (mod)
+    {
+        if (release)
+            kbd_modifiers &= ~mod;
+        else
+            kbd_modifiers |= mod;
+        return 0;
+    }
+
+    /* Key releases carry nothing, held keys repeat as more presses */
+    if (release)
+        return 0;
+
+    if (scancode == SC_PAGEUP)
+        return KEY_PAGE_UP;
+    if (scancode == SC_PAGEDOWN)
+        return KEY_PAGE_DOWN;
+
+    unsigned char c = kbdus[scancode];
+    int shift = (kbd_modifiers & KBD_SHIFT) != 0;
+
+    if (c >= 'a' && c <= 'z' && (kbd_modifiers & KBD_CAPSLOCK))
+        shift = !shift;
+    if (shift)
+        c = kbdus_shift[scancode];
+
+    if ((kbd_modifiers & KBD_CTRL) && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')))
+        c &= 0x1F;
+
+    return c;
+}
+
+/* Bottom half: decode everything the IRQ queued, interrupts enabled */
+static void kbd_softirq()
 {
     unsigned char scancode;
+    int queued = 0;
 
-    /* Read from kb data buffer */
-    scancode = inportb(0x60);
+    /*
+     * The echo and the page keys draw on the console, which a printk drain
+     * or a writer may hold on the stack we interrupted: leave the keys
+     * queued, console_unlock raises us again once it lets go.
+     */
+    if (!console_trylock())
+    {
+        console_defer(SOFTIRQ_KEYBOARD);
+        if (!console_trylock())
+            return;
+    }
 
-    /* If the top bit of the byte we read from kb  is
-    *  set, that means that a key has just been released */
-    if (scancode & 0x80)
+    while (spsc_pop(&scancodes, &scancode))
     {
-        // TODO handle shift, alt, ctrl
+        unsigned char c = kbd_decode(scancode);
+        if (!c)
+            continue;
+
+        /* the page keys belong to the console, they scroll its history */
+        if (c == KEY_PAGE_UP || c == KEY_PAGE_DOWN)
+        {
+            if (c == KEY_PAGE_UP)
+                terminal_page_up();
+            else
+                terminal_page_down();
+            continue;
+        }
+
+        /* a full buffer drops the key but still echoes it */
+        terminal_putchar(c);
+        if (spsc_push(&input, c))
+            queued = 1;
+        else
+            kbd_dropped++;
     }
-    else
+    console_unlock();
+
+    if (queued)
+        wait_queue_wake_all(&kbd_readers);
+}
+
+/*
+ * Copy up to 'len' typed characters into 'buf', blocking until there is at
+ * least one. Readers take turns with interrupts off, which keeps the ring
+ * single-consumer. The idle thread halts instead of blocking.
+ */
+size_t kbd_read(char *buf, size_t len)
+{
+    unsigned int flags = irq_save();
+    size_t n = 0;
+
+    if (!len)
     {
-        /* Handle key presses. If held , multiple interrupts will be issued */
-        terminal_putchar(kbdus[scancode]);
+        irq_restore(flags);
+        return 0;
     }
+
+    while (spsc_empty(&input))
+    {
+        if (sched_can_block())
+            wait_queue_sleep(&kbd_readers);
+        else
+            __asm__ __volatile__ ("sti; hlt; cli");
+    }
+
+    while (n < len && spsc_pop(&input, (unsigned char *) &buf[n]))
+        n++;
+
+    irq_restore(flags);
+    return n;
+}
+
+unsigned int kbd_get_modifiers()
+{
+    return kbd_modifiers;
 }
 
 /* Install keyboard handler into IRQ1 */
 void keyboard_install()
 {
+    softirq_register(SOFTIRQ_KEYBOARD, "keyboard", kbd_softirq);
     irq_install_handler(1, keyboard_handler);
 }
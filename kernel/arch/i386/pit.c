@@ -1,58 +1,101 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <kernel/system.h>
 #include <kernel/pit.h>
 #include <kernel/irq.h>
+#include <kernel/timer.h>
+#include <kernel/clock.h>
 
-#define SYS_FREQ 100
 #define IRQ0 0 
 
-unsigned int timer_ticks = 0;
-unsigned int sys_uptime = 0;
+/*
+ * Channel 0 runs in mode 0: it counts down once and raises IRQ0 at zero,
+ * then keeps counting down from 0xFFFF. The count left therefore also
+ * tells how long ago it was loaded, which makes the PIT its own clock as
+ * long as the interrupt is serviced within 0x10000 - PIT_MAX_COUNT cycles.
+ */
+#define PIT_MIN_COUNT 16        /* ~13 us, below that the IRQ is lost in the noise */
+#define PIT_MAX_COUNT 0xC000    /* ~41 ms */
 
-void timer_phase(int hz)
+/* 16.16 fixed point ns per input cycle, and 0.32 cycles per ns */
+#define PIT_NS_PER_CYCLE  54925401ull
+#define PIT_CYCLES_PER_NS 5124678ull
+
+static uint64_t pit_base = 0;   /* input cycles before the current count */
+static uint16_t pit_count = 0;  /* value the counter was last loaded with */
+
+static uint16_t pit_read_counter()
 {
-    int divisor = 1193180 / hz;       /* Calculate our divisor */
-    outportb(0x43, 0x36);             /* Set our command byte 0x36 */
-    outportb(0x40, divisor & 0xFF);   /* Set low byte of divisor */
-    outportb(0x40, divisor >> 8);     /* Set high byte of divisor */
+    outportb(PIT_COMMAND, PIT_LATCH_CH0);
+    uint16_t lo = inportb(PIT_CHANNEL0);
+    uint16_t hi = inportb(PIT_CHANNEL0);
+    return (hi << 8) | lo;
 }
 
-void timer_wait(int ticks)
+/* Input cycles since timer_install(), with interrupts disabled */
+static uint64_t pit_cycles()
 {
-    unsigned int eticks;
-    eticks = timer_ticks + ticks;
-    while(timer_ticks < eticks) 
-    {
-        __asm__ __volatile__ ("sti//hlt//cli");
-    }
+    return pit_base + (uint16_t) (pit_count - pit_read_counter());
 }
 
-/* Increment ticks every time the timer fires */
-void timer_handler(struct regs *r)
+/* The clock when there is no TSC, see kernel/clock.h */
+uint64_t pit_clock_ns()
+{
+    unsigned int flags = irq_save();
+    uint64_t cycles = pit_cycles();
+    irq_restore(flags);
+
+    return (cycles >> 16) * PIT_NS_PER_CYCLE + (((cycles & 0xFFFF) * PIT_NS_PER_CYCLE) >> 16);
+}
+
+static void pit_load(uint16_t count)
+{
+    outportb(PIT_COMMAND, PIT_ONESHOT_CH0);
+    outportb(PIT_CHANNEL0, count & 0xFF);
+    outportb(PIT_CHANNEL0, count >> 8);
+    pit_count = count;
+}
+
+/* Restart the countdown, crediting the cycles counted so far to the clock */
+static void pit_set_next_event(uint64_t delta_ns)
 {
-    /* Increment our 'tick count' */
-    timer_ticks++;
+    uint64_t count = (delta_ns * PIT_CYCLES_PER_NS) >> 32;
+
+    if (count < PIT_MIN_COUNT)
+        count = PIT_MIN_COUNT;
+    if (count > PIT_MAX_COUNT)
+        count = PIT_MAX_COUNT;
 
-    /* every 100 clocks, 1 second has gone by */
-    if (timer_ticks % 100 == 0)
-    {
-        sys_uptime += 1;
-    }
+    pit_base = pit_cycles();
+    pit_load(count);
+}
+
+static struct clock_event pit_clock_event =
+{
+    .name = "pit",
+    .min_delta_ns = PIT_MIN_COUNT * 839,
+    .max_delta_ns = PIT_MAX_COUNT * 838ull,
+    .set_next_event = pit_set_next_event,
+};
+
+void timer_handler(struct regs *r)
+{
+    (void) r;
+    timer_interrupt();
 }
 
-/* Sets up the system clock by installing the timer handler
-*  into IRQ0 */
 /* 
  * Set sys clock by installing timer handle to IRQ0
  * 
- * set timer phase at 100 hz
+ * PIT channel 0 becomes the clock-event device and the clock
 */
 void timer_install()
 {
+    unsigned int flags = irq_save();
 
-    /* Installs 'timer_handler' to IRQ0 */
     irq_install_handler(IRQ0, timer_handler);
-    timer_phase(SYS_FREQ);
+    pit_load(PIT_MAX_COUNT);
+    timer_init(&pit_clock_event);
 
+    irq_restore(flags);
 }
-
@@ -0,0 +1,485 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <slab.h>
+
+#include <kernel/pmm.h>
+#include <kernel/multiboot.h>
+#include <kernel/system.h>
+#include <kernel/printk.h>
+#include <kernel/bench.h>
+
+/* linker.ld: _kernel_start is physical, _kernel_end is virtual */
+extern char _kernel_start[];
+extern char _kernel_end[];
+
+/* 32^4 bits covers PMM_MAX_FRAMES, so at most 4 levels per order */
+#define PMM_LEVELS 4
+
+/* Upper bound on the bitmap words needed by all orders together */
+#define PMM_POOL_WORDS \
+    (2 * (PMM_MAX_FRAMES / 32) + 2 * (PMM_MAX_FRAMES / 1024) + 32 * (PMM_MAX_ORDER + 1))
+
+#define PMM_MAX_RESERVED 32
+
+/* Two bytes per frame, 2 MiB of heap */
+#define PMM_REFS_ORDER 9
+
+/*
+ * Free blocks of one order. Bit i of level[0] is set when block i (frames
+ * i << order up to (i + 1) << order) is free. Bit j of level[l + 1] is set
+ * when word j of level[l] is non-zero. level[top] is a single word.
+ */
+struct order_map
+{
+    uint32_t *level[PMM_LEVELS];
+    unsigned int top;
+    unsigned int free;
+};
+
+struct phys_range
+{
+    uint64_t start;
+    uint64_t end;
+};
+
+static uint32_t pmm_pool[PMM_POOL_WORDS];
+static struct order_map pmm_orders[PMM_MAX_ORDER + 1];
+
+static struct phys_range pmm_reserved[PMM_MAX_RESERVED];
+static unsigned int pmm_reserved_count = 0;
+
+static unsigned int free_frames = 0;
+static unsigned int total_frames = 0;
+
+/* References beyond the first, per frame. In the kernel heap, so only the
+ * pages covering frames that were looked up get memory */
+static uint16_t *frame_refs = 0;
+
+/* ======== Hierarchical bitmap ======== */
+
+static void map_set(struct order_map *m, uint32_t idx)
+{
+    for (unsigned int l = 0; l <= m->top; l++)
+    {
+        uint32_t *word = &m->level[l][idx >> 5];
+        uint32_t was = *word;
+
+        *word = was | (1u << (idx & 31));
+
+        /* upper levels already know this word is non-empty */
+        if (was)
+            break;
+        idx >>= 5;
+    }
+}
+
+static void map_clear(struct order_map *m, uint32_t idx)
+{
+    for (unsigned int l = 0; l <= m->top; l++)
+    {
+        uint32_t *word = &m->level[l][idx >> 5];
+
+        *word &= ~(1u << (idx & 31));
+
+        /* the word still has free blocks, nothing changes above */
+        if (*word)
+            break;
+        idx >>= 5;
+    }
+}
+
+static int map_test(struct order_map *m, uint32_t idx)
+{
+    return (m->level[0][idx >> 5] >> (idx & 31)) & 1;
+}
+
+/* Lowest set bit. Only valid when m->free != 0 */
+static uint32_t map_first(struct order_map *m)
+{
+    uint32_t idx = 0;
+
+    for (int l = m->top; l >= 0; l--)
+        idx = (idx << 5) | __builtin_ctz(m->level[l][idx]);
+
+    return idx;
+}
+
+static void pmm_init_maps()
+{
+    uint32_t *pool = pmm_pool;
+
+    for (unsigned int order = 0; order <= PMM_MAX_ORDER; order++)
+    {
+        struct order_map *m = &pmm_orders[order];
+        uint32_t bits = PMM_MAX_FRAMES >> order;
+        unsigned int l = 0;
+
+        for (;;)
+        {
+            uint32_t words = (bits + 31) / 32;
+
+            m->level[l] = pool;
+            pool += words;
+            if (words == 1)
+                break;
+            bits = words;
+            l++;
+        }
+        m->top = l;
+        m->free = 0;
+    }
+
+    if (pool > pmm_pool + PMM_POOL_WORDS)
+        panic("pmm: bitmap pool too small");
+}
+
+/* ======== Buddy allocator ======== */
+
+/* Hand a block back, merging with its buddy for as long as it is free */
+static void buddy_free(uint32_t frame, unsigned int order)
+{
+    uint32_t idx = frame >> order;
+
+    if (map_test(&pmm_orders[order], idx))
+        panic("pmm: double free");
+
+    while (order < PMM_MAX_ORDER && map_test(&pmm_orders[order], idx ^ 1))
+    {
+        map_clear(&pmm_orders[order], idx ^ 1);
+        pmm_orders[order].free--;
+        idx >>= 1;
+        order++;
+    }
+
+    map_set(&pmm_orders[order], idx);
+    pmm_orders[order].free++;
+}
+
+uint32_t pmm_alloc_frames(unsigned int order)
+{
+    unsigned int flags = irq_save();
+    unsigned int k = order;
+
+    /* smallest order with a free block, at most PMM_MAX_ORDER probes */
+    while (k <= PMM_MAX_ORDER && !pmm_orders[k].free)
+        k++;
+    if (k > PMM_MAX_ORDER)
+    {
+        irq_restore(flags);
+        return 0;
+    }
+
+    uint32_t idx = map_first(&pmm_orders[k]);
+    map_clear(&pmm_orders[k], idx);
+    pmm_orders[k].free--;
+
+    /* split, keeping the lower half and freeing the upper one */
+    while (k > order)
+    {
+        k--;
+        idx <<= 1;
+        map_set(&pmm_orders[k], idx | 1);
+        pmm_orders[k].free++;
+    }
+
+    free_frames -= 1u << order;
+    irq_restore(flags);
+    return (idx << order) << PAGE_SHIFT;
+}
+
+void pmm_free_frames(uint32_t addr, unsigned int order)
+{
+    if (!addr || (addr & ((PAGE_SIZE << order) - 1)))
+        panic("pmm: bad free");
+
+    unsigned int flags = irq_save();
+    buddy_free(addr >> PAGE_SHIFT, order);
+    free_frames += 1u << order;
+    irq_restore(flags);
+}
+
+uint32_t pmm_alloc_frame()
+{
+    return pmm_alloc_frames(0);
+}
+
+void pmm_free_frame(uint32_t addr)
+{
+    unsigned int flags = irq_save();
+    uint16_t *refs = frame_refs ? &frame_refs[addr >> PAGE_SHIFT] : 0;
+
+    if (refs && *refs)
+    {
+        (*refs)--;
+        irq_restore(flags);
+        return;
+    }
+    irq_restore(flags);
+    pmm_free_frames(addr, 0);
+}
+
+int pmm_frame_ref(uint32_t addr)
+{
+    if (!frame_refs)
+    {
+        uint16_t *table = kpage_alloc(PMM_REFS_ORDER);
+        if (!table)
+            return -1;
+
+        unsigned int flags = irq_save();
+        if (frame_refs)
+            kpage_free(table, PMM_REFS_ORDER);
+        else
+            frame_refs = table;
+        irq_restore(flags);
+    }
+
+    unsigned int flags = irq_save();
+    uint16_t *refs = &frame_refs[addr >> PAGE_SHIFT];
+    int ret = *refs < UINT16_MAX ? 0 : -1;
+    if (!ret)
+        (*refs)++;
+    irq_restore(flags);
+    return ret;
+}
+
+unsigned int pmm_frame_refs(uint32_t addr)
+{
+    return 1 + (frame_refs ? frame_refs[addr >> PAGE_SHIFT] : 0);
+}
+
+unsigned int pmm_free_count()
+{
+    return free_frames;
+}
+
+unsigned int pmm_total_count()
+{
+    return total_frames;
+}
+
+/* ======== Boot time setup ======== */
+
+/* Free every whole frame in [start, end) as the largest aligned blocks */
+static void pmm_free_range(uint64_t start, uint64_t end)
+{
+    uint64_t limit = (uint64_t) PMM_MAX_FRAMES << PAGE_SHIFT;
+
+    if (end > limit)
+        end = limit;
+    if (start >= end)
+        return;
+
+    uint32_t first = (start + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    uint32_t last = end >> PAGE_SHIFT;
+
+    while (first < last)
+    {
+        unsigned int order = 0;
+
+        while (order < PMM_MAX_ORDER
+               && !(first & ((2u << order) - 1))
+               && first + (2u << order) <= last)
+            order++;
+
+        buddy_free(first, order);
+        free_frames += 1u << order;
+        total_frames += 1u << order;
+        first += 1u << order;
+    }
+}
+
+/* Keep the list sorted by start address */
+static void pmm_reserve(uint64_t start, uint64_t end)
+{
+    unsigned int i;
+
+    if (start >= end)
+        return;
+    if (pmm_reserved_count == PMM_MAX_RESERVED)
+        panic("pmm: too many reserved ranges");
+
+    for (i = pmm_reserved_count; i > 0 && pmm_reserved[i - 1].start > start; i--)
+        pmm_reserved[i] = pmm_reserved[i - 1];
+
+    pmm_reserved[i].start = start;
+    pmm_reserved[i].end = end;
+    pmm_reserved_count++;
+}
+
+/* Free an available region, skipping everything reserved */
+static void pmm_add_region(uint64_t start, uint64_t end)
+{
+    uint64_t cur = start;
+
+    for (unsigned int i = 0; i < pmm_reserved_count; i++)
+    {
+        struct phys_range *r = &pmm_reserved[i];
+
+        if (r->end <= cur)
+            continue;
+        if (r->start >= end)
+            break;
+        if (r->start > cur)
+            pmm_free_range(cur, r->start);
+        if (r->end > cur)
+            cur = r->end;
+    }
+
+    if (cur < end)
+        pmm_free_range(cur, end);
+}
+
+/* Multiboot data is only readable while it sits inside the boot mapping */
+static void *boot_ptr(uint32_t addr, uint32_t len)
+{
+    if (addr + len > PMM_BOOT_WINDOW || addr + len < addr)
+        return 0;
+    return phys_to_virt(addr);
+}
+
+/* Reserve everything GRUB handed over, so later subsystems can still read it */
+static void pmm_reserve_multiboot(struct multiboot_info *mbi)
+{
+    uint32_t mbi_addr = (uint32_t) mbi - KERNEL_VIRTUAL_BASE;
+
+    pmm_reserve(mbi_addr, mbi_addr + sizeof(*mbi));
+
+    if (mbi->flags & MULTIBOOT_INFO_MEM_MAP)
+        pmm_reserve(mbi->mmap_addr, (uint64_t) mbi->mmap_addr + mbi->mmap_length);
+
+    if (mbi->flags & MULTIBOOT_INFO_CMDLINE)
+    {
+        const char *cmdline = boot_ptr(mbi->cmdline, 1);
+        uint32_t len = cmdline ? strlen(cmdline) + 1 : PAGE_SIZE;
+        pmm_reserve(mbi->cmdline, (uint64_t) mbi->cmdline + len);
+    }
+
+    if (mbi->flags & MULTIBOOT_INFO_MODS)
+    {
+        uint32_t size = mbi->mods_count * sizeof(struct multiboot_mod_list);
+        struct multiboot_mod_list *mods = boot_ptr(mbi->mods_addr, size);
+
+        pmm_reserve(mbi->mods_addr, (uint64_t) mbi->mods_addr + size);
+        for (uint32_t i = 0; mods && i < mbi->mods_count; i++)
+            pmm_reserve(mods[i].mod_start, mods[i].mod_end);
+    }
+}
+
+/*
+ * Seed the allocator from the multiboot memory map.
+ *
+ * Everything starts out reserved. Only the regions the bootloader reports as
+ * available RAM are released, minus the first 1 MiB (real mode IVT, BIOS data,
+ * VGA and ROMs), the kernel image and the multiboot structures themselves.
+ */
+void pmm_init(struct multiboot_info *mbi)
+{
+    pmm_init_maps();
+
+    pmm_reserve(0, 0x100000);
+    pmm_reserve((uint32_t) _kernel_start, (uint32_t) _kernel_end - KERNEL_VIRTUAL_BASE);
+    pmm_reserve_multiboot(mbi);
+
+    struct multiboot_mmap_entry *entry = 0;
+    if (mbi->flags & MULTIBOOT_INFO_MEM_MAP)
+        entry = boot_ptr(mbi->mmap_addr, mbi->mmap_length);
+
+    if (entry)
+    {
+        uint32_t end = (uint32_t) entry + mbi->mmap_length;
+
+        while ((uint32_t) entry < end)
+        {
+            if (entry->type == MULTIBOOT_MEMORY_AVAILABLE)
+                pmm_add_region(entry->addr, entry->addr + entry->len);
+            entry = (struct multiboot_mmap_entry *) ((uint32_t) entry + entry->size + sizeof(entry->size));
+        }
+    }
+    else if (mbi->flags & MULTIBOOT_INFO_MEMORY)
+    {
+        /* No usable map, trust mem_upper (KiB starting at 1 MiB) */
+        pmm_add_region(0x100000, 0x100000 + (uint64_t) mbi->mem_upper * 1024);
+    }
+    else
+    {
+        panic("pmm: bootloader provided no memory information");
+    }
+
+    printk(LOG_INFO, "pmm: %u KiB usable, %u KiB free\n",
+           total_frames * (PAGE_SIZE / 1024), free_frames * (PAGE_SIZE / 1024));
+}
+
+/* ======== Self-test ======== */
+
+#define PMM_SELFTEST_FRAMES 1024
+#define PMM_SELFTEST_ORDER  4
+
+static uint32_t selftest_frames[PMM_SELFTEST_FRAMES];
+
+static int pmm_in_kernel(uint32_t addr)
+{
+    return addr >= (uint32_t) _kernel_start
+        && addr < (uint32_t) _kernel_end - KERNEL_VIRTUAL_BASE;
+}
+
+/*
+ * Allocate and free a batch of single frames, then a batch of 64 KiB blocks,
+ * checking every address and reporting the average cost in TSC cycles.
+ */
+void pmm_selftest()
+{
+    unsigned int before = pmm_free_count();
+    unsigned int n, blocks, i;
+    unsigned long long t0, t1, t2, t3, t4, t5;
+
+    t0 = rdtsc();
+    for (n = 0; n < PMM_SELFTEST_FRAMES; n++)
+    {
+        selftest_frames[n] = pmm_alloc_frame();
+        if (!selftest_frames[n])
+            break;
+    }
+    t1 = rdtsc();
+    for (i = 0; i < n; i++)
+        pmm_free_frame(selftest_frames[i]);
+    t2 = rdtsc();
+
+    for (i = 0; i < n; i++)
+        if (pmm_in_kernel(selftest_frames[i]))
+            panic("pmm: self-test got a frame inside the kernel");
+
+    t3 = rdtsc();
+    for (blocks = 0; blocks < PMM_SELFTEST_FRAMES >> PMM_SELFTEST_ORDER; blocks++)
+    {
+        selftest_frames[blocks] = pmm_alloc_frames(PMM_SELFTEST_ORDER);
+        if (!selftest_frames[blocks])
+            break;
+        if (selftest_frames[blocks] & ((PAGE_SIZE << PMM_SELFTEST_ORDER) - 1))
+            panic("pmm: self-test got a misaligned block");
+    }
+    t4 = rdtsc();
+    for (i = 0; i < blocks; i++)
+        pmm_free_frames(selftest_frames[i], PMM_SELFTEST_ORDER);
+    t5 = rdtsc();
+
+    if (pmm_free_count() != before)
+        panic("pmm: self-test leaked frames");
+
+    if (!n || !blocks)
+    {
+        printk(LOG_WARNING, "pmm: self-test skipped, out of memory\n");
+        return;
+    }
+
+    unsigned int alloc = (t1 - t0) / n, free = (t2 - t1) / n;
+    unsigned int alloc_block = (t4 - t3) / blocks, free_block = (t5 - t4) / blocks;
+
+    printk(LOG_INFO, "pmm: self-test ok, 4 KiB alloc %u / free %u cycles, 64 KiB alloc %u / free %u cycles\n",
+           alloc, free, alloc_block, free_block);
+    bench_report("pmm_alloc_4k", alloc, "cycles");
+    bench_report("pmm_free_4k", free, "cycles");
+    bench_report("pmm_alloc_64k", alloc_block, "cycles");
+    bench_report("pmm_free_64k", free_block, "cycles");
+}
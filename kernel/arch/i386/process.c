@@ -0,0 +1,529 @@
+#include <stdint.h>
+#include <string.h>
+#include <slab.h>
+
+#include <kernel/process.h>
+#include <kernel/sched.h>
+#include <kernel/syscall.h>
+#include <kernel/pmm.h>
+#include <kernel/vmm.h>
+#include <kernel/fpu.h>
+#include <kernel/system.h>
+#include <kernel/printk.h>
+#include <kernel/bench.h>
+
+static unsigned int next_pid = 1;
+
+/* Every vm_object in use, looked up by file address */
+static struct vm_object *objects = 0;
+
+/* ======== Shared file pages ======== */
+
+/* The object for a read-only file range, with one more user. Interrupts off */
+static struct vm_object *vm_object_get(const uint8_t *file, uint32_t size)
+{
+    struct vm_object *o;
+
+    for (o = objects; o; o = o->next)
+        if (o->file == file && o->size == size)
+        {
+            o->refs++;
+            return o;
+        }
+
+    uint32_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    o = kmalloc(sizeof(*o));
+    uint32_t *frames = o ? kmalloc(pages * sizeof(uint32_t)) : 0;
+    if (!frames)
+    {
+        kfree(o);
+        return 0;
+    }
+    memset(frames, 0, pages * sizeof(uint32_t));
+
+    o->file = file;
+    o->size = size;
+    o->frames = frames;
+    o->refs = 1;
+    o->next = objects;
+    objects = o;
+    return o;
+}
+
+/* The last user gone, the pages go too. Interrupts off */
+static void vm_object_put(struct vm_object *o)
+{
+    if (--o->refs)
+        return;
+
+    struct vm_object **link = &objects;
+    while (*link != o)
+        link = &(*link)->next;
+    *link = o->next;
+
+    for (uint32_t i = 0; i < (o->size + PAGE_SIZE - 1) / PAGE_SIZE; i++)
+        if (o->frames[i])
+            pmm_free_frame(o->frames[i]);
+    kfree(o->frames);
+    kfree(o);
+}
+
+/* ======== Processes ======== */
+
+/* First thing the new thread runs, still in ring 0 */
+static void process_start(void *arg)
+{
+    struct process *p = arg;
+
+    unsigned int irq = irq_save();
+    thread_current()->proc = p;
+    vmm_switch(p->space);
+    irq_restore(irq);
+
+    p->setup(p->setup_arg);
+    process_exit(-1);
+}
+
+/* Areas and the process itself, the address space is already gone */
+static void process_free(struct process *p)
+{
+    unsigned int irq = irq_save();
+    while (p->areas)
+    {
+        struct vm_area *a = p->areas;
+        p->areas = a->next;
+        if (a->object)
+            vm_object_put(a->object);
+        kfree(a);
+    }
+    irq_restore(irq);
+    kfree(p);
+}
+
+/* Give 'p' a pid and a thread, or free it all */
+static int process_run(struct process *p, void (*setup)(void *arg), void *arg)
+{
+    p->pid = next_pid++;
+    p->setup = setup;
+    p->setup_arg = arg;
+    p->minor_faults = 0;
+    p->major_faults = 0;
+
+    /* the thread may run and even finish before thread_create returns */
+    int pid = p->pid;
+    if (!thread_create(p->name, process_start, p, SCHED_PRIORITY_DEFAULT))
+    {
+        vmm_space_destroy(p->space);
+        process_free(p);
+        return -1;
+    }
+    return pid;
+}
+
+int process_create(const char *name, void (*setup)(void *arg), void *arg)
+{
+    struct process *p = kmalloc(sizeof(*p));
+    if (!p)
+        return -1;
+
+    p->space = vmm_space_create();
+    if (!p->space)
+    {
+        kfree(p);
+        return -1;
+    }
+
+    p->name = name;
+    p->areas = 0;
+    return process_run(p, setup, arg);
+}
+
+/* What the child of a fork starts from */
+struct fork_state
+{
+    struct regs frame;
+    void *fpu_state;
+};
+
+static void fork_child(void *arg)
+{
+    struct fork_state *f = arg;
+    struct regs frame = f->frame;
+
+    if (f->fpu_state)
+        fpu_adopt(f->fpu_state);
+    kfree(f);
+    enter_user_frame(&frame);
+}
+
+int process_fork(struct regs *r)
+{
+    struct process *parent = process_current();
+    if (!parent)
+        return -1;
+
+    struct process *p = kmalloc(sizeof(*p));
+    struct fork_state *f = p ? kmalloc(sizeof(*f)) : 0;
+    if (!f)
+    {
+        kfree(p);
+        return -1;
+    }
+
+    p->name = parent->name;
+    p->areas = 0;
+    p->space = vmm_space_fork();
+    if (!p->space)
+        goto fail;
+
+    /* the areas, in the same order, with their file pages still shared */
+    unsigned int irq = irq_save();
+    struct vm_area **tail = &p->areas;
+    for (struct vm_area *a = parent->areas; a; a = a->next)
+    {
+        struct vm_area *copy = kmalloc(sizeof(*copy));
+        if (!copy)
+        {
+            irq_restore(irq);
+            vmm_space_destroy(p->space);
+            goto fail;
+        }
+        *copy = *a;
+        copy->next = 0;
+        if (copy->object)
+            copy->object->refs++;
+        *tail = copy;
+        tail = &copy->next;
+    }
+    irq_restore(irq);
+
+    /* returns 0 in the child, on the instruction after its parent's int $0x80 */
+    f->frame = *r;
+    f->frame.eax = 0;
+    f->fpu_state = fpu_clone();
+
+    int pid = process_run(p, fork_child, f);
+    if (pid < 0)
+    {
+        if (f->fpu_state)
+            fpu_discard(f->fpu_state);
+        kfree(f);
+    }
+    return pid;
+
+fail:
+    process_free(p);
+    kfree(f);
+    return -1;
+}
+
+void process_exit(int status)
+{
+    struct thread *t = thread_current();
+    struct process *p = t->proc;
+
+    printk(LOG_DEBUG, "process %u (%s): exit %d\n", p->pid, p->name, status);
+    if (p->minor_faults || p->major_faults)
+        printk(LOG_INFO, "process %u (%s): %u minor, %u major page faults\n",
+               p->pid, p->name, p->minor_faults, p->major_faults);
+
+    /* from here on schedule() keeps us on the kernel's address space */
+    unsigned int irq = irq_save();
+    t->proc = 0;
+    vmm_space_destroy(p->space);
+    irq_restore(irq);
+
+    process_free(p);
+    thread_exit();
+}
+
+struct process *process_current()
+{
+    struct thread *t = thread_current();
+    return t ? t->proc : 0;
+}
+
+int process_map(struct process *p, uint32_t start, uint32_t end, uint32_t flags,
+                const void *file, uint32_t file_size)
+{
+    if (start >= end || end > KERNEL_VIRTUAL_BASE || (start | end) & (PAGE_SIZE - 1) ||
+        file_size > end - start)
+        return -1;
+    for (struct vm_area *a = p->areas; a; a = a->next)
+        if (start < a->end && a->start < end)
+            return -1;
+
+    struct vm_area *a = kmalloc(sizeof(*a));
+    if (!a)
+        return -1;
+    a->start = start;
+    a->end = end;
+    a->flags = flags;
+    a->file = file;
+    a->file_size = file_size;
+    a->object = 0;
+
+    /* the fault handler walks the list with interrupts off */
+    unsigned int irq = irq_save();
+    if (file_size && !(flags & VMM_WRITE))
+    {
+        a->object = vm_object_get(file, file_size);
+        if (!a->object)
+        {
+            irq_restore(irq);
+            kfree(a);
+            return -1;
+        }
+    }
+    a->next = p->areas;
+    p->areas = a;
+    irq_restore(irq);
+    return 0;
+}
+
+/* Fill a new page of 'a' from its file bytes and zeros, 1 if there were file bytes */
+static int area_fill(struct vm_area *a, uint32_t page, uint32_t frame)
+{
+    uint32_t offset = page - a->start;
+    uint32_t n = 0;
+
+    if (vmm_map(page, frame, VMM_WRITE))
+        return -1;
+
+    /* filled while only the kernel may write, then given the area's rights */
+    if (offset < a->file_size)
+    {
+        n = a->file_size - offset < PAGE_SIZE ? a->file_size - offset : PAGE_SIZE;
+        memcpy((void *) page, a->file + offset, n);
+    }
+    memset((void *) (page + n), 0, PAGE_SIZE - n);
+    vmm_protect(page, a->flags);
+    return n != 0;
+}
+
+int process_page_fault(uint32_t addr, uint32_t err)
+{
+    struct process *p = process_current();
+    struct vm_area *a;
+
+    if (!p || addr >= KERNEL_VIRTUAL_BASE)
+        return 0;
+
+    /* a write to a page shared since fork */
+    if (err & VMM_FAULT_PRESENT)
+    {
+        if (!(err & VMM_FAULT_WRITE) || !vmm_copy_on_write(addr))
+            return 0;
+        p->minor_faults++;
+        return 1;
+    }
+
+    for (a = p->areas; a; a = a->next)
+        if (addr >= a->start && addr < a->end)
+            break;
+    if (!a || ((err & VMM_FAULT_WRITE) && !(a->flags & VMM_WRITE)))
+        return 0;
+
+    uint32_t page = addr & ~(PAGE_SIZE - 1);
+    uint32_t index = (page - a->start) / PAGE_SIZE;
+    struct vm_object *o = (a->object && page - a->start < a->file_size) ? a->object : 0;
+
+    /* read by another process already: map the same frame */
+    if (o && o->frames[index])
+    {
+        if (vmm_map(page, o->frames[index], a->flags))
+            return 0;
+        if (pmm_frame_ref(o->frames[index]))
+        {
+            vmm_unmap(page);
+            return 0;
+        }
+        p->minor_faults++;
+        return 1;
+    }
+
+    uint32_t frame = pmm_alloc_frame();
+    if (!frame)
+        return 0;
+
+    int major = area_fill(a, page, frame);
+    if (major < 0 || (o && pmm_frame_ref(frame)))
+    {
+        if (major >= 0)
+            vmm_unmap(page);
+        pmm_free_frame(frame);
+        return 0;
+    }
+
+    /* the object keeps a reference of its own until its last area goes */
+    if (o)
+        o->frames[index] = frame;
+    if (major)
+        p->major_faults++;
+    else
+        p->minor_faults++;
+    return 1;
+}
+
+int user_map_code(uint32_t virt, const void *code, size_t size)
+{
+    for (size_t done = 0; done < size; done += PAGE_SIZE)
+    {
+        uint32_t frame = pmm_alloc_frame();
+        size_t n = size - done < PAGE_SIZE ? size - done : PAGE_SIZE;
+
+        if (!frame || vmm_map(virt + done, frame, VMM_WRITE))
+        {
+            if (frame)
+                pmm_free_frame(frame);
+            return -1;
+        }
+
+        /* written while only the kernel may, then handed to ring 3 read-only */
+        memcpy((void *) (virt + done), (const uint8_t *) code + done, n);
+        memset((void *) (virt + done + n), 0, PAGE_SIZE - n);
+        vmm_protect(virt + done, VMM_USER);
+    }
+    return 0;
+}
+
+/* ======== Benchmark ======== */
+
+#define PROCESS_BENCH_ROUNDS 10000
+
+#define PROCESS_BENCH_CODE  0x08048000
+#define PROCESS_BENCH_STACK (KERNEL_VIRTUAL_BASE - PAGE_SIZE)
+
+/* lives in boot.S, position independent */
+extern char process_bench_user[];
+extern char process_bench_user_end[];
+
+static void process_bench_setup(void *fpu)
+{
+    if (user_map_code(PROCESS_BENCH_CODE, process_bench_user, process_bench_user_end - process_bench_user) ||
+        vmm_reserve(PROCESS_BENCH_STACK, VMM_USER | VMM_WRITE))
+        return;
+
+    /* the round count and whether to touch the FPU, faults the stack in */
+    uint32_t *sp = (uint32_t *) (PROCESS_BENCH_STACK + PAGE_SIZE - 2 * sizeof(uint32_t));
+    sp[0] = PROCESS_BENCH_ROUNDS;
+    sp[1] = (uint32_t) fpu;
+    enter_user(PROCESS_BENCH_CODE, (uint32_t) sp);
+}
+
+/* Started from the idle thread so both processes exist before either runs */
+static void process_bench_spawn(void *fpu)
+{
+    if (process_create("bench-a", process_bench_setup, fpu) < 0 ||
+        process_create("bench-b", process_bench_setup, fpu) < 0)
+        printk(LOG_WARNING, "process: no memory for the switch benchmark\n");
+}
+
+/* Cycles per switch, called from the idle thread: it runs again once both exited */
+static unsigned int process_bench_run(int fpu)
+{
+    unsigned long long start = rdtsc();
+
+    if (!thread_create("bench-spawn", process_bench_spawn, (void *) fpu, SCHED_PRIORITY_DEFAULT))
+        return 0;
+    return (rdtsc() - start) / (2 * PROCESS_BENCH_ROUNDS);
+}
+
+/*
+ * Two processes yielding to each other through int $0x80: every switch
+ * changes address space. Then the same with an x87 instruction before
+ * each yield, so every switch also moves the FPU state through #NM.
+ */
+void process_switch_bench()
+{
+    unsigned int plain = process_bench_run(0);
+    unsigned int fpu = process_bench_run(1);
+
+    printk(LOG_INFO, "process: %u cycles per yield and switch, %u with the FPU in use\n", plain, fpu);
+    bench_report("process_switch", plain, "cycles");
+    bench_report("process_switch_fpu", fpu, "cycles");
+}
+
+#define FORK_BENCH_ROUNDS 64
+
+#define FORK_BENCH_CODE 0x08048000
+#define FORK_BENCH_HEAP 0x10000000
+
+/* lives in boot.S */
+extern char fork_bench_user[];
+extern char fork_bench_user_end[];
+
+struct fork_bench
+{
+    uint32_t resident;          /* bytes the parent has written */
+    const char *cycles_name;
+    const char *memory_name;
+
+    unsigned int cycles;        /* per fork and exit */
+    unsigned int frames;        /* taken by each fork */
+};
+
+static struct fork_bench fork_benches[] = {
+    { 64 * 1024,        "fork_exit_64k", "fork_mem_64k", 0, 0 },
+    { 1024 * 1024,      "fork_exit_1m",  "fork_mem_1m",  0, 0 },
+    { 16 * 1024 * 1024, "fork_exit_16m", "fork_mem_16m", 0, 0 },
+};
+
+/* The parent, in ring 0: forks children that start on the exit code */
+static void fork_bench_parent(void *arg)
+{
+    struct fork_bench *b = arg;
+    struct process *p = process_current();
+
+    if (user_map_code(FORK_BENCH_CODE, fork_bench_user, fork_bench_user_end - fork_bench_user) ||
+        process_map(p, FORK_BENCH_HEAP, FORK_BENCH_HEAP + b->resident, VMM_USER | VMM_WRITE, 0, 0))
+        return;
+    for (uint32_t v = FORK_BENCH_HEAP; v < FORK_BENCH_HEAP + b->resident; v += PAGE_SIZE)
+        *(volatile uint32_t *) v = v;
+
+    struct regs frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.gs = frame.fs = frame.es = frame.ds = frame.ss = 0x23;
+    frame.cs = 0x1B;
+    frame.eip = FORK_BENCH_CODE;
+    frame.eflags = 0x202;
+
+    unsigned int frames = 0;
+    unsigned long long start = rdtsc();
+    for (int i = 0; i < FORK_BENCH_ROUNDS; i++)
+    {
+        unsigned int free = pmm_free_count();
+        if (process_fork(&frame) < 0)
+            return;
+        frames += free - pmm_free_count();
+
+        /* the child runs and exits before we are back */
+        sched_yield();
+    }
+    b->cycles = (rdtsc() - start) / FORK_BENCH_ROUNDS;
+    b->frames = frames / FORK_BENCH_ROUNDS;
+}
+
+/*
+ * A parent with more and more memory written forks children that exit
+ * straight away. Copy-on-write keeps both the time and the memory per
+ * child down to the page tables, not the resident size. Called from the
+ * idle thread: it runs again once the parent and every child exited.
+ */
+void process_fork_bench()
+{
+    for (size_t i = 0; i < sizeof(fork_benches) / sizeof(fork_benches[0]); i++)
+    {
+        struct fork_bench *b = &fork_benches[i];
+
+        if (process_create("bench-fork", fork_bench_parent, b) < 0 || !b->cycles)
+        {
+            printk(LOG_WARNING, "fork: no memory for the benchmark\n");
+            return;
+        }
+        printk(LOG_INFO, "fork: %u KiB resident: %u cycles per fork and exit, %u KiB per child\n",
+               b->resident / 1024, b->cycles, b->frames * (PAGE_SIZE / 1024));
+        bench_report(b->cycles_name, b->cycles, "cycles");
+        bench_report(b->memory_name, b->frames * (PAGE_SIZE / 1024), "KiB");
+    }
+}
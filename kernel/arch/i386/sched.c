@@ -0,0 +1,392 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <slab.h>
+
+#include <kernel/sched.h>
+#include <kernel/gdt.h>
+#include <kernel/vmm.h>
+#include <kernel/fpu.h>
+#include <kernel/process.h>
+#include <kernel/pmm.h>
+#include <kernel/timer.h>
+#include <kernel/clock.h>
+#include <kernel/system.h>
+#include <kernel/printk.h>
+#include <kernel/bench.h>
+
+struct ready_queue
+{
+    struct thread *head;
+    struct thread *tail;
+};
+
+static struct ready_queue ready[SCHED_PRIORITIES];
+static uint32_t ready_bitmap = 0;   /* bit n set when ready[n] is non-empty */
+
+static struct thread *current = 0;
+static struct thread *idle_thread = 0;
+static struct thread *all_threads = 0;
+static struct thread *zombie = 0;   /* exited, freed once off its stack */
+
+static struct kmem_cache *thread_cache;
+static unsigned int next_id = 0;
+static volatile int need_resched = 0;
+
+static void ready_push(struct thread *t)
+{
+    struct ready_queue *q = &ready[t->priority];
+
+    t->state = THREAD_READY;
+    t->next = 0;
+    if (q->tail)
+        q->tail->next = t;
+    else
+        q->head = t;
+    q->tail = t;
+    ready_bitmap |= 1u << t->priority;
+}
+
+/* Highest priority ready thread, or 0 */
+static struct thread *ready_pop()
+{
+    if (!ready_bitmap)
+        return 0;
+
+    unsigned int prio = __builtin_ctz(ready_bitmap);
+    struct ready_queue *q = &ready[prio];
+    struct thread *t = q->head;
+
+    q->head = t->next;
+    if (!q->head)
+    {
+        q->tail = 0;
+        ready_bitmap &= ~(1u << prio);
+    }
+    t->next = 0;
+    return t;
+}
+
+static void thread_free(struct thread *t)
+{
+    struct thread **p = &all_threads;
+
+    while (*p != t)
+        p = &(*p)->all_next;
+    *p = t->all_next;
+
+    fpu_release(t);
+    kpage_free(t->stack, THREAD_STACK_ORDER);
+    kmem_cache_free(thread_cache, t);
+}
+
+/* Pick the next thread and switch to it. Safe to call with interrupts off */
+void schedule()
+{
+    unsigned int flags = irq_save();
+    struct thread *prev = current;
+    struct thread *next;
+
+    need_resched = 0;
+
+    if (prev->state == THREAD_RUNNING && prev != idle_thread)
+        ready_push(prev);
+
+    next = ready_pop();
+    if (!next)
+        next = idle_thread;
+
+    next->state = THREAD_RUNNING;
+    if (!next->slice)
+        next->slice = SCHED_TIMESLICE;
+
+    if (next != prev)
+    {
+        unsigned long long now = rdtsc();
+
+        prev->cpu_cycles += now - prev->switched_in;
+        next->switched_in = now;
+        current = next;
+
+        /* where the CPU puts us when next comes in from ring 3 */
+        if (next->stack)
+            tss_set_kernel_stack((uint32_t) next->stack + (PAGE_SIZE << THREAD_STACK_ORDER));
+        vmm_switch(next->proc ? next->proc->space : 0);
+        fpu_switch(next);
+
+        /* the tick stops while idle, someone has to preempt next now */
+        if (prev == idle_thread)
+            timer_tick_resume();
+
+        switch_context(&prev->esp, next->esp);
+
+        /* back on prev's stack, whoever exited before us can go now */
+        if (zombie && zombie != current)
+        {
+            thread_free(zombie);
+            zombie = 0;
+        }
+    }
+
+    irq_restore(flags);
+}
+
+void sched_yield()
+{
+    current->slice = 0;
+    schedule();
+}
+
+/* Called from the timer interrupt */
+void sched_tick()
+{
+    if (!current)
+        return;
+
+    current->cpu_ticks++;
+    if (current == idle_thread)
+    {
+        if (ready_bitmap)
+            need_resched = 1;
+    }
+    else if (!current->slice || !--current->slice)
+    {
+        need_resched = 1;
+    }
+}
+
+/* Called by irq_handler once the interrupt has been acknowledged */
+void sched_preempt()
+{
+    if (current && need_resched)
+        schedule();
+}
+
+struct thread *thread_current()
+{
+    return current;
+}
+
+/* Only the idle thread runs and nothing is waiting for the CPU */
+int sched_idle()
+{
+    return current == idle_thread && !ready_bitmap;
+}
+
+/* The idle thread has to stay runnable, everyone else may sleep */
+int sched_can_block()
+{
+    return current && current != idle_thread;
+}
+
+struct thread *thread_create(const char *name, void (*entry)(void *arg), void *arg,
+                             unsigned int priority)
+{
+    struct thread *t = kmem_cache_alloc(thread_cache);
+    if (!t)
+        return 0;
+
+    t->stack = kpage_alloc(THREAD_STACK_ORDER);
+    if (!t->stack)
+    {
+        kmem_cache_free(thread_cache, t);
+        return 0;
+    }
+
+    /* Fault the stack in now: a #PF on a missing stack page can't be handled */
+    uint32_t size = PAGE_SIZE << THREAD_STACK_ORDER;
+    memset(t->stack, 0, size);
+
+    /*
+     * Initial frame, as if switch_context had saved it: edi, esi, ebx, ebp,
+     * return into thread_trampoline, which pops and calls entry(arg).
+     */
+    uint32_t *sp = (uint32_t *) ((uint32_t) t->stack + size);
+    *--sp = (uint32_t) arg;
+    *--sp = (uint32_t) entry;
+    *--sp = (uint32_t) thread_trampoline;
+    *--sp = 0;  /* ebp */
+    *--sp = 0;  /* ebx */
+    *--sp = 0;  /* esi */
+    *--sp = 0;  /* edi */
+    t->esp = (uint32_t) sp;
+
+    t->name = name;
+    t->priority = priority < SCHED_PRIORITIES ? priority : SCHED_PRIORITIES - 1;
+    t->slice = SCHED_TIMESLICE;
+    t->cpu_ticks = 0;
+    t->cpu_cycles = 0;
+    t->switched_in = 0;
+    t->proc = 0;
+    t->fpu_state = 0;
+
+    unsigned int flags = irq_save();
+    t->id = next_id++;
+    t->all_next = all_threads;
+    all_threads = t;
+    ready_push(t);
+    if (t->priority < current->priority || current == idle_thread)
+        need_resched = 1;
+    irq_restore(flags);
+
+    /* the idle thread may not see another interrupt for a while */
+    if (need_resched && current == idle_thread)
+        schedule();
+
+    return t;
+}
+
+void thread_exit()
+{
+    irq_save();
+
+    /* a previous zombie is still waiting, we are not running on its stack */
+    if (zombie)
+        thread_free(zombie);
+
+    current->state = THREAD_DEAD;
+    zombie = current;
+    schedule();
+
+    __builtin_unreachable();
+}
+
+/* ======== Wait queues ======== */
+
+void wait_queue_sleep(struct wait_queue *wq)
+{
+    unsigned int flags = irq_save();
+
+    current->state = THREAD_BLOCKED;
+    current->next = 0;
+    if (wq->tail)
+        wq->tail->next = current;
+    else
+        wq->head = current;
+    wq->tail = current;
+
+    schedule();
+    irq_restore(flags);
+}
+
+static void wake(struct thread *t)
+{
+    ready_push(t);
+    if (t->priority < current->priority || current == idle_thread)
+        need_resched = 1;
+}
+
+void wait_queue_wake_one(struct wait_queue *wq)
+{
+    unsigned int flags = irq_save();
+    struct thread *t = wq->head;
+
+    if (t)
+    {
+        wq->head = t->next;
+        if (!wq->head)
+            wq->tail = 0;
+        wake(t);
+    }
+    irq_restore(flags);
+}
+
+void wait_queue_wake_all(struct wait_queue *wq)
+{
+    unsigned int flags = irq_save();
+    struct thread *t = wq->head;
+
+    wq->head = wq->tail = 0;
+    while (t)
+    {
+        struct thread *next = t->next;
+        wake(t);
+        t = next;
+    }
+    irq_restore(flags);
+}
+
+/* ======== Setup and statistics ======== */
+
+/* The boot context becomes the idle thread */
+void sched_init()
+{
+    thread_cache = kmem_cache_create("thread", sizeof(struct thread), 0, 0);
+    if (!thread_cache)
+        panic("sched: no memory for the thread cache");
+
+    idle_thread = kmem_cache_alloc(thread_cache);
+    if (!idle_thread)
+        panic("sched: no memory for the idle thread");
+
+    memset(idle_thread, 0, sizeof(*idle_thread));
+    idle_thread->id = next_id++;
+    idle_thread->name = "idle";
+    idle_thread->state = THREAD_RUNNING;
+    idle_thread->priority = SCHED_PRIORITIES - 1;
+    idle_thread->switched_in = rdtsc();
+    all_threads = idle_thread;
+    current = idle_thread;
+}
+
+void sched_stats()
+{
+    static const char *states[] = { "ready", "running", "blocked", "dead" };
+    unsigned int flags = irq_save();
+
+    /* charge the running thread up to now */
+    unsigned long long now = rdtsc();
+    current->cpu_cycles += now - current->switched_in;
+    current->switched_in = now;
+
+    for (struct thread *t = all_threads; t; t = t->all_next)
+    {
+        printk(LOG_INFO, "%u %s: %s, %u ticks, %llu ms\n",
+               t->id, t->name, states[t->state], t->cpu_ticks,
+               clock_cycles_to_ns(t->cpu_cycles) / 1000000);
+    }
+    irq_restore(flags);
+}
+
+/* ======== Benchmark ======== */
+
+#define SWITCH_BENCH_ROUNDS 10000
+
+static unsigned long long switch_bench_cycles;
+static int switch_bench_failed;
+
+/*
+ * The first thread starts its partner, from then on the two take turns
+ * and each yield is one switch to the other.
+ */
+static void switch_bench_thread(void *first)
+{
+    if (first && !thread_create("bench-b", switch_bench_thread, 0, SCHED_PRIORITY_DEFAULT))
+    {
+        switch_bench_failed = 1;
+        thread_exit();
+    }
+
+    unsigned long long start = rdtsc();
+    for (int i = 0; i < SWITCH_BENCH_ROUNDS; i++)
+        sched_yield();
+    if (first)
+        switch_bench_cycles = rdtsc() - start;
+    thread_exit();
+}
+
+/* Called from the idle thread, which only runs again once both are done */
+void sched_switch_bench()
+{
+    switch_bench_failed = 0;
+    if (!thread_create("bench-a", switch_bench_thread, (void *) 1, SCHED_PRIORITY_DEFAULT) ||
+        switch_bench_failed)
+    {
+        printk(LOG_WARNING, "sched: no memory for the switch benchmark\n");
+        return;
+    }
+
+    unsigned int cost = switch_bench_cycles / (2 * SWITCH_BENCH_ROUNDS);
+    printk(LOG_INFO, "sched: %u cycles per context switch\n", cost);
+    bench_report("sched_switch", cost, "cycles");
+}
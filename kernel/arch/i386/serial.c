@@ -0,0 +1,65 @@
+#include <stddef.h>
+
+#include <kernel/serial.h>
+#include <kernel/printk.h>
+#include <kernel/system.h>
+
+/* 16550 registers, offsets from the base port */
+#define UART_DATA    0
+#define UART_IER     1              /* interrupt enable */
+#define UART_FCR     2              /* FIFO control */
+#define UART_LCR     3              /* line control, bit 7 selects the divisor */
+#define UART_MCR     4              /* modem control */
+#define UART_LSR     5              /* line status */
+#define UART_SCRATCH 7
+
+#define UART_LSR_THRE 0x20          /* transmit holding register empty */
+
+#define UART_CLOCK 115200
+
+static int serial_present = 0;
+
+static struct console serial_console = {
+    .name = "serial",
+    .write = serial_write,
+};
+
+int serial_init(void)
+{
+    /* nothing answers on an empty port, the scratch register reads back 0xFF */
+    outportb(SERIAL_COM1 + UART_SCRATCH, 0x5A);
+    if (inportb(SERIAL_COM1 + UART_SCRATCH) != 0x5A)
+        return 0;
+
+    outportb(SERIAL_COM1 + UART_IER, 0x00);
+    outportb(SERIAL_COM1 + UART_LCR, 0x80);
+    outportb(SERIAL_COM1 + UART_DATA, UART_CLOCK / 115200);
+    outportb(SERIAL_COM1 + UART_IER, 0x00);
+    outportb(SERIAL_COM1 + UART_LCR, 0x03);     /* 8 bits, no parity, 1 stop */
+    outportb(SERIAL_COM1 + UART_FCR, 0xC7);     /* enable and clear the FIFOs */
+    outportb(SERIAL_COM1 + UART_MCR, 0x03);     /* DTR, RTS, no interrupts */
+
+    serial_present = 1;
+    console_register(&serial_console);
+    return 1;
+}
+
+static void serial_putc(char c)
+{
+    while (!(inportb(SERIAL_COM1 + UART_LSR) & UART_LSR_THRE))
+        ;
+    outportb(SERIAL_COM1 + UART_DATA, c);
+}
+
+void serial_write(const char *s, size_t len)
+{
+    if (!serial_present)
+        return;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (s[i] == '\n')
+            serial_putc('\r');
+        serial_putc(s[i]);
+    }
+}
@@ -0,0 +1,204 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <kernel/syscall.h>
+#include <kernel/idt.h>
+#include <kernel/gdt.h>
+#include <kernel/pmm.h>
+#include <kernel/vmm.h>
+#include <kernel/sched.h>
+#include <kernel/process.h>
+#include <kernel/tty.h>
+#include <kernel/system.h>
+#include <kernel/printk.h>
+#include <kernel/bench.h>
+
+int syscall_sysenter = 0;
+
+/* sys_write copies through a buffer of this size on the kernel stack */
+#define WRITE_CHUNK 256
+
+/* ======== Handlers ======== */
+
+/* Nothing at all, for measuring the way in and out */
+static int sys_null(uint32_t a, uint32_t b, uint32_t c)
+{
+    (void) a, (void) b, (void) c;
+    return 0;
+}
+
+static int sys_exit(uint32_t status, uint32_t b, uint32_t c)
+{
+    (void) b, (void) c;
+    if (process_current())
+        process_exit(status);
+    thread_exit();
+}
+
+/* Standard output and error both go to the terminal */
+static int sys_write(uint32_t fd, uint32_t buf, uint32_t len)
+{
+    char chunk[WRITE_CHUNK];
+
+    if (fd != 1 && fd != 2)
+        return -1;
+    if (buf >= KERNEL_VIRTUAL_BASE || len > KERNEL_VIRTUAL_BASE - buf)
+        return -1;
+
+    /* a bad pointer ends the write, whatever came before it is written */
+    for (uint32_t done = 0; done < len; )
+    {
+        uint32_t n = len - done < WRITE_CHUNK ? len - done : WRITE_CHUNK;
+
+        if (copy_from_user(chunk, (const void *) (buf + done), n))
+            return done ? (int) done : -1;
+        console_lock();
+        terminal_write(chunk, n);
+        console_unlock();
+        done += n;
+    }
+    return len;
+}
+
+static int sys_yield(uint32_t a, uint32_t b, uint32_t c)
+{
+    (void) a, (void) b, (void) c;
+    sched_yield();
+    return 0;
+}
+
+/* Only int $0x80 saves the whole user frame a child starts from, see
+ * syscall_handler. This is what SYSENTER reaches */
+static int sys_fork(uint32_t a, uint32_t b, uint32_t c)
+{
+    (void) a, (void) b, (void) c;
+    return -1;
+}
+
+syscall_fn syscall_table[SYSCALL_MAX] =
+{
+    [SYS_null]  = sys_null,
+    [SYS_exit]  = sys_exit,
+    [SYS_write] = sys_write,
+    [SYS_yield] = sys_yield,
+    [SYS_fork]  = sys_fork,
+};
+
+/* ======== Entry ======== */
+
+/* int $0x80, from syscall_stub */
+void syscall_handler(struct regs *r)
+{
+    __asm__ __volatile__ ("sti" : : : "memory");
+
+    if (r->eax == SYS_fork)
+        r->eax = process_fork(r);
+    else if (r->eax < SYSCALL_MAX)
+        r->eax = syscall_table[r->eax](r->ebx, r->ecx, r->edx);
+    else
+        r->eax = -1;
+}
+
+void syscall_install()
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    idt_set_gate(SYSCALL_VECTOR, (unsigned) syscall_stub, GDT_KERNEL_CODE, 0xEE);
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    /* early Pentium Pros report SEP without having it */
+    unsigned int family = (eax >> 8) & 0xF, model = (eax >> 4) & 0xF, stepping = eax & 0xF;
+    if (!(edx & CPUID_FEAT_EDX_SEP) || (family == 6 && model < 3 && stepping < 3))
+    {
+        printk(LOG_INFO, "syscall: int $0x80 only, no SYSENTER\n");
+        return;
+    }
+
+    /* sysenter_entry loads the stack from tss.esp0, the one an int $0x80 gets */
+    wrmsr(MSR_SYSENTER_CS, GDT_KERNEL_CODE);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t) &tss.esp0);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t) sysenter_entry);
+    syscall_sysenter = 1;
+
+    printk(LOG_INFO, "syscall: int $0x80 and SYSENTER\n");
+}
+
+/* ======== Benchmark ======== */
+
+#define SYSCALL_BENCH_ROUNDS 10000
+
+/* Where the ring 3 half runs, below the kernel and away from anything else */
+#define SYSCALL_BENCH_CODE  0x40000000
+#define SYSCALL_BENCH_STACK 0x40001000
+
+/* lives in boot.S, position independent */
+extern char syscall_bench_user[];
+extern char syscall_bench_user_end[];
+
+/* What the ring 3 half finds on its stack, and fills in */
+struct syscall_bench_args
+{
+    uint32_t rounds;
+    uint32_t int80_cycles;
+    uint32_t sysenter_cycles;
+    uint32_t sysenter;
+};
+
+static void syscall_bench_thread(void *arg)
+{
+    enter_user(SYSCALL_BENCH_CODE, (uint32_t) arg);
+}
+
+/*
+ * Runs SYSCALL_BENCH_ROUNDS null system calls through each entry from a
+ * kernel thread dropped to ring 3, which exits through SYS_exit. Called
+ * from the idle thread, so that thread is done when we run again.
+ */
+void syscall_bench()
+{
+    uint32_t code = pmm_alloc_frame();
+    uint32_t stack = pmm_alloc_frame();
+
+    if (!code || !stack ||
+        vmm_map(SYSCALL_BENCH_CODE, code, VMM_WRITE) ||
+        vmm_map(SYSCALL_BENCH_STACK, stack, VMM_WRITE | VMM_USER))
+    {
+        printk(LOG_WARNING, "syscall: no memory for the benchmark\n");
+        goto out;
+    }
+
+    memcpy((void *) SYSCALL_BENCH_CODE, syscall_bench_user, syscall_bench_user_end - syscall_bench_user);
+    vmm_protect(SYSCALL_BENCH_CODE, VMM_USER);
+
+    struct syscall_bench_args *args =
+        (struct syscall_bench_args *) (SYSCALL_BENCH_STACK + PAGE_SIZE - sizeof(*args));
+    memset(args, 0, sizeof(*args));
+    args->rounds = SYSCALL_BENCH_ROUNDS;
+    args->sysenter = syscall_sysenter;
+
+    if (!thread_create("syscall-bench", syscall_bench_thread, args, SCHED_PRIORITY_DEFAULT))
+    {
+        printk(LOG_WARNING, "syscall: no memory for the benchmark\n");
+        goto out;
+    }
+
+    unsigned int int80 = args->int80_cycles / SYSCALL_BENCH_ROUNDS;
+    unsigned int sysenter = args->sysenter_cycles / SYSCALL_BENCH_ROUNDS;
+
+    if (syscall_sysenter)
+        printk(LOG_INFO, "syscall: null call %u cycles via int $0x80, %u via SYSENTER\n", int80, sysenter);
+    else
+        printk(LOG_INFO, "syscall: null call %u cycles via int $0x80\n", int80);
+    bench_report("syscall_int80", int80, "cycles");
+    if (syscall_sysenter)
+        bench_report("syscall_sysenter", sysenter, "cycles");
+
+out:
+    vmm_unmap(SYSCALL_BENCH_CODE);
+    vmm_unmap(SYSCALL_BENCH_STACK);
+    if (code)
+        pmm_free_frame(code);
+    if (stack)
+        pmm_free_frame(stack);
+}
@@ -0,0 +1,413 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <slab.h>
+
+#include <kernel/timer.h>
+#include <kernel/sched.h>
+#include <kernel/system.h>
+#include <kernel/printk.h>
+#include <kernel/bench.h>
+
+uint64_t timer_ticks = 0;
+
+static struct clock_event *clock_event = 0;
+static unsigned int timer_irqs = 0;
+static unsigned long long timer_irq_cycles = 0;
+
+static struct timer tick_timer;
+static int tick_nohz = 1;       /* stop the tick while idle */
+
+/* ======== Timing wheel ======== */
+
+#define WHEEL_MASK  (TIMER_WHEEL_SIZE - 1)
+#define WHEEL_RANGE (1ull << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+#define WHEEL_NONE  (~0ull)
+
+static struct timer *wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+static uint64_t wheel_busy[TIMER_WHEEL_LEVELS];    /* bit n: slot n non-empty */
+static uint64_t wheel_clock = 0;                    /* next level 0 slot to run */
+static uint64_t wheel_programmed = WHEEL_NONE;      /* slot the device fires at */
+
+static void wheel_insert(struct timer *t)
+{
+    /* deadline in level 0 slots, rounded up, and never in the past */
+    uint64_t when = (t->expires + (1ull << TIMER_WHEEL_SHIFT) - 1) >> TIMER_WHEEL_SHIFT;
+    if (when < wheel_clock)
+        when = wheel_clock;
+    if (when - wheel_clock >= WHEEL_RANGE)
+        when = wheel_clock + WHEEL_RANGE - 1;   /* re-filed when cascaded */
+
+    uint64_t delta = when - wheel_clock;
+    unsigned int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >> (TIMER_WHEEL_BITS * (level + 1)))
+        level++;
+
+    unsigned int slot = (when >> (TIMER_WHEEL_BITS * level)) & WHEEL_MASK;
+    struct timer **head = &wheel[level][slot];
+
+    t->next = *head;
+    if (t->next)
+        t->next->pprev = &t->next;
+    t->pprev = head;
+    *head = t;
+    wheel_busy[level] |= 1ull << slot;
+}
+
+static void wheel_remove(struct timer *t)
+{
+    struct timer **first = &wheel[0][0];
+    unsigned int index = t->pprev - first;
+
+    *t->pprev = t->next;
+    if (t->next)
+        t->next->pprev = t->pprev;
+
+    /* it was alone at the head of its slot, the slot is empty now */
+    if (index < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SIZE && !*t->pprev)
+        wheel_busy[index / TIMER_WHEEL_SIZE] &= ~(1ull << (index % TIMER_WHEEL_SIZE));
+
+    t->next = 0;
+    t->pprev = 0;
+}
+
+/* Lowest set bit of a non-zero word, without a libgcc call */
+static inline unsigned int ctz64(uint64_t v)
+{
+    uint32_t lo = v;
+    return lo ? __builtin_ctz(lo) : 32 + __builtin_ctz(v >> 32);
+}
+
+/* First level 0 slot at or after wheel_clock with work, cascades included */
+static uint64_t wheel_next()
+{
+    uint64_t next = WHEEL_NONE;
+
+    for (unsigned int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        uint64_t busy = wheel_busy[level];
+        if (!busy)
+            continue;
+
+        /* a level is visited when the clock crosses one of its slot boundaries */
+        unsigned int shift = TIMER_WHEEL_BITS * level;
+        uint64_t pos = (wheel_clock + (1ull << shift) - 1) >> shift;
+        unsigned int rot = pos & WHEEL_MASK;
+
+        if (rot)
+            busy = (busy >> rot) | (busy << (TIMER_WHEEL_SIZE - rot));
+
+        uint64_t when = (pos + ctz64(busy)) << shift;
+        if (when < next)
+            next = when;
+    }
+    return next;
+}
+
+/* Move every timer of a higher level slot down to where it belongs now */
+static void wheel_cascade(unsigned int level)
+{
+    unsigned int slot = (wheel_clock >> (TIMER_WHEEL_BITS * level)) & WHEEL_MASK;
+    struct timer *t = wheel[level][slot];
+
+    wheel[level][slot] = 0;
+    wheel_busy[level] &= ~(1ull << slot);
+    while (t)
+    {
+        struct timer *next = t->next;
+        wheel_insert(t);
+        t = next;
+    }
+}
+
+/* Run every slot up to and including the one 'now' falls in */
+static void wheel_run(uint64_t now)
+{
+    uint64_t now_slot = now >> TIMER_WHEEL_SHIFT;
+
+    while (wheel_clock <= now_slot)
+    {
+        uint64_t next = wheel_next();
+        if (next > now_slot)
+        {
+            wheel_clock = now_slot + 1;
+            break;
+        }
+        wheel_clock = next;
+
+        /* crossing a boundary of level n means a slot of level n comes due */
+        for (unsigned int level = 1; level < TIMER_WHEEL_LEVELS; level++)
+        {
+            if (wheel_clock & ((1ull << (TIMER_WHEEL_BITS * level)) - 1))
+                break;
+            wheel_cascade(level);
+        }
+
+        /* detach the slot first, callbacks may add timers for this slot */
+        unsigned int slot = wheel_clock & WHEEL_MASK;
+        struct timer *t = wheel[0][slot];
+
+        wheel[0][slot] = 0;
+        wheel_busy[0] &= ~(1ull << slot);
+        wheel_clock++;
+
+        while (t)
+        {
+            struct timer *next = t->next;
+
+            t->next = 0;
+            t->pprev = 0;
+            t->fn(t->arg);
+            t = next;
+        }
+    }
+}
+
+/* Program the device for the next slot with work, or its longest delay */
+static void timer_program(uint64_t now)
+{
+    uint64_t delta = clock_event->max_delta_ns;
+    uint64_t next = wheel_next();
+
+    wheel_programmed = next;
+    if (next != WHEEL_NONE)
+    {
+        uint64_t when = next << TIMER_WHEEL_SHIFT;
+
+        if (when <= now)
+            delta = 0;
+        else if (when - now < delta)
+            delta = when - now;
+    }
+    if (delta < clock_event->min_delta_ns)
+        delta = clock_event->min_delta_ns;
+
+    clock_event->set_next_event(delta);
+}
+
+void timer_add(struct timer *t, uint64_t expires)
+{
+    unsigned int flags = irq_save();
+
+    if (timer_pending(t))
+        wheel_remove(t);
+
+    t->expires = expires;
+    wheel_insert(t);
+
+    /* a new earliest deadline moves the next interrupt forward */
+    if (clock_event && wheel_next() < wheel_programmed)
+        timer_program(clock_monotonic_ns());
+    irq_restore(flags);
+}
+
+int timer_mod(struct timer *t, uint64_t expires)
+{
+    int pending = timer_pending(t);
+
+    timer_add(t, expires);
+    return pending;
+}
+
+int timer_cancel(struct timer *t)
+{
+    unsigned int flags = irq_save();
+    int pending = timer_pending(t);
+
+    /* the interrupt may come early now, it just finds nothing to do */
+    if (pending)
+        wheel_remove(t);
+    irq_restore(flags);
+    return pending;
+}
+
+/* Called from the clock-event device interrupt */
+void timer_interrupt()
+{
+    unsigned long long start = rdtsc();
+    uint64_t now = clock_monotonic_ns();
+
+    wheel_run(now);
+    timer_program(now);
+
+    timer_irqs++;
+    timer_irq_cycles += rdtsc() - start;
+}
+
+/* ======== Scheduler tick ======== */
+
+static void tick_fn(void *arg)
+{
+    (void) arg;
+
+    timer_ticks++;
+    sched_tick();
+
+    /* nothing to preempt, timer_tick_resume() restarts us */
+    if (tick_nohz && sched_idle())
+        return;
+
+    uint64_t next = tick_timer.expires + TICK_NS;
+    uint64_t now = clock_monotonic_ns();
+
+    /* don't replay ticks lost with interrupts off */
+    if (next <= now)
+        next = now + TICK_NS;
+    timer_add(&tick_timer, next);
+}
+
+void timer_tick_resume()
+{
+    unsigned int flags = irq_save();
+
+    /* before timer_install() there is nothing to tick with */
+    if (clock_event && !timer_pending(&tick_timer))
+        timer_add(&tick_timer, clock_monotonic_ns() + TICK_NS);
+    irq_restore(flags);
+}
+
+void timer_init(struct clock_event *dev)
+{
+    clock_event = dev;
+    timer_setup(&tick_timer, tick_fn, 0);
+    wheel_clock = clock_monotonic_ns() >> TIMER_WHEEL_SHIFT;
+    timer_program(clock_monotonic_ns());
+}
+
+/* ======== Sleeping ======== */
+
+static void sleep_wake(void *arg)
+{
+    wait_queue_wake_all(arg);
+}
+
+void timer_sleep_ns(uint64_t ns)
+{
+    struct wait_queue wq = { 0, 0 };
+    struct timer t;
+    unsigned int flags = irq_save();
+
+    timer_setup(&t, sleep_wake, &wq);
+    timer_add(&t, clock_monotonic_ns() + ns);
+
+    while (timer_pending(&t))
+    {
+        /* the idle thread may not block, it waits for the interrupt instead */
+        if (sched_can_block())
+            wait_queue_sleep(&wq);
+        else
+            __asm__ __volatile__ ("sti; hlt; cli");
+    }
+    irq_restore(flags);
+}
+
+void timer_usleep(unsigned int us)
+{
+    timer_sleep_ns((uint64_t) us * 1000);
+}
+
+void timer_wait(int ticks)
+{
+    timer_sleep_ns((uint64_t) ticks * TICK_NS);
+}
+
+/* ======== Benchmarks ======== */
+
+static unsigned int idle_irqs_per_second()
+{
+    unsigned int start = timer_irqs;
+
+    timer_sleep_ns(1000000000ull);
+    return timer_irqs - start;
+}
+
+/*
+ * Count timer interrupts over one idle second with the tick forced on,
+ * which is what the old 100 Hz rate generator cost, and again tickless.
+ */
+void timer_idle_bench()
+{
+    tick_nohz = 0;
+    timer_tick_resume();
+    unsigned int periodic = idle_irqs_per_second();
+
+    /* the tick notices it is idle on its next run and stops */
+    tick_nohz = 1;
+    timer_sleep_ns(2 * TICK_NS);
+    unsigned int tickless = idle_irqs_per_second();
+
+    uint64_t start = clock_monotonic_ns();
+    timer_usleep(100);
+    unsigned int slept = clock_monotonic_ns() - start;
+
+    printk(LOG_INFO, "timer: idle irq/s: %u periodic tick, %u tickless; usleep(100) took %u ns\n",
+           periodic, tickless, slept);
+    bench_report("timer_idle_periodic", periodic, "irq/s");
+    bench_report("timer_idle_tickless", tickless, "irq/s");
+    bench_report("timer_usleep_100", slept, "ns");
+}
+
+#define WHEEL_BENCH_TIMERS 100000
+
+static void wheel_bench_fn(void *arg)
+{
+    (void) arg;
+}
+
+/* Average cycles spent in timer_interrupt over 100 ms of ticking */
+static unsigned int tick_cost()
+{
+    tick_nohz = 0;
+    timer_tick_resume();
+
+    unsigned int irqs = timer_irqs;
+    unsigned long long cycles = timer_irq_cycles;
+    timer_sleep_ns(10 * TICK_NS);
+
+    tick_nohz = 1;
+    return (timer_irq_cycles - cycles) / (timer_irqs - irqs);
+}
+
+/*
+ * Arm WHEEL_BENCH_TIMERS timers spread over the next minute, measure what
+ * a tick costs with all of them outstanding, then cancel them again.
+ */
+void timer_wheel_bench()
+{
+    struct timer *timers = kmalloc(WHEEL_BENCH_TIMERS * sizeof(struct timer));
+    uint32_t seed = 1;
+
+    if (!timers)
+    {
+        printk(LOG_WARNING, "timer: no memory for the wheel bench\n");
+        return;
+    }
+
+    unsigned int empty = tick_cost();
+
+    uint64_t now = clock_monotonic_ns();
+    unsigned long long start = rdtsc();
+    for (int i = 0; i < WHEEL_BENCH_TIMERS; i++)
+    {
+        /* 1 s to 1 min out, none of them fires during the bench */
+        seed = seed * 1103515245 + 12345;
+        timer_setup(&timers[i], wheel_bench_fn, 0);
+        timer_add(&timers[i], now + 1000000000ull + (seed >> 6) * 880ull);
+    }
+    unsigned int add = (rdtsc() - start) / WHEEL_BENCH_TIMERS;
+
+    unsigned int loaded = tick_cost();
+
+    start = rdtsc();
+    for (int i = 0; i < WHEEL_BENCH_TIMERS; i++)
+        timer_cancel(&timers[i]);
+    unsigned int cancel = (rdtsc() - start) / WHEEL_BENCH_TIMERS;
+
+    kfree(timers);
+
+    printk(LOG_INFO, "timer: %u timers: add %u cycles, cancel %u cycles; tick %u cycles empty, %u loaded\n",
+           WHEEL_BENCH_TIMERS, add, cancel, empty, loaded);
+    bench_report("timer_add", add, "cycles");
+    bench_report("timer_cancel", cancel, "cycles");
+    bench_report("timer_tick_empty", empty, "cycles");
+    bench_report("timer_tick_loaded", loaded, "cycles");
+}
@@ -2,42 +2,159 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdio.h>
+
+#include <slab.h>
 
 #include <kernel/tty.h>
+#include <kernel/fbcon.h>
+#include <kernel/printk.h>
+#include <kernel/bench.h>
 #include <kernel/pit.h>
+#include <kernel/irq.h>
+#include <kernel/timer.h>
+#include <kernel/system.h>
 
 #include "vga.h"
 
 #include <limits.h> // INT_MIN and INT_MAX
 
 /*
- * SCROLLBACK HANDLE
- * 
- * Alloc enough space for ONE terminal screen in the 
- * terminal buffer. (VGA_HEIGHT * VGA_WIDTH)
- * 
- * Upon term scrolling we alloc more space dynamically 
+ * SCROLLBACK
+ *
+ * Every line ever printed lives in a ring of MAX_SCROLLBACK lines; the
+ * screen is a window onto its last VGA_HEIGHT lines. Scrolling bumps the
+ * window start and copies the window to VGA memory once, nothing is moved.
+ * Until the heap is up (terminal_scrollback_init) the ring is just the
+ * screen, in static storage.
+ *
+ * SHADOW
+ *
+ * Drawing only touches the ring, which doubles as the shadow of the
+ * screen, and marks screen rows dirty. terminal_flush copies dirty rows to
+ * VGA memory in 32-bit moves. Once timers run, a flush is scheduled
+ * TTY_FLUSH_NS after the first change, so a burst of output costs one copy
+ * per frame rather than an MMIO store per character; before that, rows are
+ * flushed at every newline.
  *
- * TODO implement a memory manager!!!
+ * When the bootloader set up a linear framebuffer, flushed rows go to the
+ * framebuffer console (fbcon.c) instead of VGA text memory, which is the
+ * only difference between the two.
 */
 #define MAX_SCROLLBACK 10000 // DEFAULT!
 #define BACKSPACE 0x08 
 #define TAB 0x09 
 
-static const size_t VGA_WIDTH = 80;
-static const size_t VGA_HEIGHT = 25;
+#define VGA_WIDTH 80
+#define VGA_HEIGHT 25
 
-// 1024th page reservered for VGA text buffer - see boot.S
-static uint16_t* const VGA_MEMORY = (uint16_t*) 0xC03FF000;
+#define TTY_FLUSH_NS 10000000ull    // 10 ms, at most 100 flushes a second
+
+// boot.S maps all of low memory into the higher half, VGA text buffer included
+static uint16_t* const VGA_MEMORY = (uint16_t*) 0xC00B8000;
 
 static size_t terminal_row;
 static size_t terminal_column;
 static uint8_t terminal_color;
 static uint16_t* terminal_buffer;
 
+static volatile uint32_t dirty_rows = 0;   // bit y: screen row y not flushed yet
+static int flush_deferred = 0;             // flush_timer does the flushing
+static struct timer flush_timer;
+
+static uint16_t boot_lines[VGA_HEIGHT][VGA_WIDTH];
+static uint16_t (*lines)[VGA_WIDTH] = boot_lines;
+static size_t lines_count = VGA_HEIGHT; // ring size
+static size_t screen_top = 0;           // ring index of screen row 0
+static size_t history = 0;              // lines kept above the screen
+static size_t view_offset = 0;          // lines the view is scrolled back
+
 unsigned int curr_fg_color;
 unsigned int curr_bg_color;
 
+/* ring line shown 'row' rows below ring line 'top' */
+static uint16_t *ring_line(size_t top, size_t row) {
+	size_t index = top + row;
+	if (index >= lines_count)
+		index -= lines_count;
+	return lines[index];
+}
+
+static void fill_line(uint16_t *line) {
+	uint16_t blank = vga_entry(' ', terminal_color);
+	for (size_t x = 0; x < VGA_WIDTH; x++)
+		line[x] = blank;
+}
+
+static void vga_draw_row(size_t y, const uint16_t *cells) {
+	copy_dwords(&terminal_buffer[y * VGA_WIDTH], cells, VGA_WIDTH * sizeof(uint16_t) / 4);
+}
+
+// where terminal_flush sends rows
+static void (*draw_row)(size_t y, const uint16_t *cells) = vga_draw_row;
+
+static void flush_timer_fn(void *arg) {
+	(void) arg;
+	softirq_raise(SOFTIRQ_TTY);
+}
+
+static void mark_dirty(uint32_t rows) {
+	dirty_rows |= rows;
+	if (flush_deferred && !timer_pending(&flush_timer))
+		timer_add(&flush_timer, clock_monotonic_ns() + TTY_FLUSH_NS);
+}
+
+/* Copy the dirty rows of the visible window to the screen */
+void terminal_flush(void) {
+	unsigned int flags = irq_save();
+	uint32_t rows = dirty_rows;
+	dirty_rows = 0;
+	irq_restore(flags);
+
+	size_t top = screen_top + lines_count - view_offset;
+	if (top >= lines_count)
+		top -= lines_count;
+
+	while (rows) {
+		size_t y = __builtin_ctz(rows);
+		rows &= rows - 1;
+		draw_row(y, ring_line(top, y));
+	}
+}
+
+/* the whole window changed */
+static void terminal_refresh(void) {
+	mark_dirty((1u << VGA_HEIGHT) - 1);
+}
+
+/* O(1): a new blank line enters at the bottom, the top one becomes history */
+static void terminal_scroll(void) {
+	if (++screen_top == lines_count)
+		screen_top = 0;
+	if (history < lines_count - VGA_HEIGHT)
+		history++;
+
+	fill_line(ring_line(screen_top, VGA_HEIGHT - 1));
+	terminal_refresh();
+}
+
+static void terminal_newline(void) {
+	terminal_column = 0;
+	if (terminal_row + 1 < VGA_HEIGHT)
+		terminal_row++;
+	else
+		terminal_scroll();
+
+	if (!flush_deferred)
+		terminal_flush();
+}
+
+static struct console tty_console = {
+	.name = "tty",
+	.write = terminal_write,
+	.flush = terminal_flush,
+};
+
 void terminal_initialize(void) {
 	terminal_row = 0;
 	terminal_column = 0;
@@ -48,26 +165,78 @@ void terminal_initialize(void) {
 	terminal_color = vga_entry_color(curr_fg_color, curr_bg_color);
 
 	terminal_buffer = VGA_MEMORY;
-	for (size_t y = 0; y < VGA_HEIGHT; y++) {
-		for (size_t x = 0; x < VGA_WIDTH; x++) {
-			const size_t index = y * VGA_WIDTH + x;
-			terminal_buffer[index] = vga_entry(' ', terminal_color);
-		}
-	}
+	for (size_t y = 0; y < VGA_HEIGHT; y++)
+		fill_line(ring_line(screen_top, y));
+	terminal_refresh();
+	terminal_flush();
+	console_register(&tty_console);
+}
+
+/* Batch flushes from now on, needs timers and softirqs */
+void terminal_flush_timer_init(void) {
+	timer_setup(&flush_timer, flush_timer_fn, 0);
+	softirq_register(SOFTIRQ_TTY, "tty", terminal_flush);
+	flush_deferred = 1;
+	terminal_flush();
 }
 
-/* reset cursor positions and clear terminal buffer */
+/* Move the screen into a heap ring that can hold MAX_SCROLLBACK lines */
+void terminal_scrollback_init(void) {
+	uint16_t (*ring)[VGA_WIDTH] = kmalloc(MAX_SCROLLBACK * sizeof(*ring));
+	if (!ring)
+		return;
+
+	for (size_t y = 0; y < VGA_HEIGHT; y++)
+		memcpy(ring[y], ring_line(screen_top, y), sizeof(*ring));
+
+	lines = ring;
+	lines_count = MAX_SCROLLBACK;
+	screen_top = 0;
+	history = 0;
+	view_offset = 0;
+}
+
+/* reset cursor positions and clear the screen, history is kept */
 void terminal_clear()
 {
 	terminal_row = 0;
 	terminal_column = 0;
+	view_offset = 0;
 
-	for (size_t y = 0; y < VGA_HEIGHT; y++) {
-		for (size_t x = 0; x < VGA_WIDTH; x++) {
-			const size_t index = y * VGA_WIDTH + x;
-			terminal_buffer[index] = vga_entry(' ', terminal_color);
-		}
-	}
+	for (size_t y = 0; y < VGA_HEIGHT; y++)
+		fill_line(ring_line(screen_top, y));
+	terminal_refresh();
+	if (!flush_deferred)
+		terminal_flush();
+}
+
+/* Move the console to the framebuffer, if the bootloader left one */
+void terminal_framebuffer_init(struct multiboot_info *mbi) {
+	if (!fbcon_init(mbi, VGA_WIDTH, VGA_HEIGHT))
+		return;
+
+	draw_row = fbcon_draw_row;
+	terminal_refresh();
+	terminal_flush();
+}
+
+/* Scroll the view 'rows' lines back into history (negative: forward) */
+void terminal_scroll_view(int rows) {
+	if (rows < 0 && (size_t) -rows > view_offset)
+		view_offset = 0;
+	else if (rows > 0 && view_offset + rows > history)
+		view_offset = history;
+	else
+		view_offset += rows;
+	terminal_refresh();
+}
+
+void terminal_page_up(void) {
+	terminal_scroll_view(VGA_HEIGHT - 1);
+}
+
+void terminal_page_down(void) {
+	terminal_scroll_view(-(VGA_HEIGHT - 1));
 }
 
 void terminal_setcolor(uint8_t color) {
@@ -75,24 +244,36 @@ void terminal_setcolor(uint8_t color) {
 }
 
 void terminal_putentryat(unsigned char c, uint8_t color, size_t x, size_t y) {
-	const size_t index = y * VGA_WIDTH + x;
-	terminal_buffer[index] = vga_entry(c, color);
+	ring_line(screen_top, y)[x] = vga_entry(c, color);
+	if (!view_offset)
+		mark_dirty(1u << y);
+}
+
+// new output brings the view back from history
+static inline void terminal_follow(void) {
+	if (view_offset) {
+		view_offset = 0;
+		terminal_refresh();
+	}
 }
 
 void terminal_putchar(char c) {
 	unsigned char uc = c;
+
+    terminal_follow();
     
-    // backspace
-    if (c == BACKSPACE && terminal_column != 0) {
-        terminal_column -= 1;
-        // "remove" char from buffer
-        uc = ' ';
-        terminal_putentryat(uc, terminal_color, terminal_column, terminal_row);
-        terminal_column -= 1;
+    // backspace: step back and "remove" the char from the buffer
+    if (c == BACKSPACE) {
+        if (terminal_column != 0) {
+            terminal_column -= 1;
+            terminal_putentryat(' ', terminal_color, terminal_column, terminal_row);
+        }
     }
     // tab: inc col to a point that is divisible by 8
     else if (c == TAB) {
         terminal_column = (terminal_column + 8) & ~(8 - 1);
+        if (terminal_column >= VGA_WIDTH)
+            terminal_newline();
     }
     // carriage return 
     else if (c == '\r') {
@@ -100,25 +281,55 @@ void terminal_putchar(char c) {
     }
     // newline handle, behave like <CR> and then move down a row
     else if (c == '\n') {
-        terminal_column = 0;
-        terminal_row += 1;
+        terminal_newline();
     }
     // we print the character
-    else if (c >= ' ') {
+    else if (uc >= ' ') {
         terminal_putentryat(uc, terminal_color, terminal_column, terminal_row);
+        if (++terminal_column == VGA_WIDTH)
+            terminal_newline();
     }
-    
-    // TODO handle scrollback buffering
-	if (++terminal_column == VGA_WIDTH) {
-		terminal_column = 0;
-		if (++terminal_row == VGA_HEIGHT)
-			terminal_row = 0;
+}
+
+/* Printable characters only: straight into the row, wrapping at its end */
+static void terminal_write_run(const unsigned char* data, size_t size) {
+	const uint16_t attr = (uint16_t) terminal_color << 8;
+
+	while (size) {
+		size_t n = VGA_WIDTH - terminal_column;
+		if (n > size)
+			n = size;
+
+		uint16_t* cell = ring_line(screen_top, terminal_row) + terminal_column;
+		for (size_t i = 0; i < n; i++)
+			cell[i] = attr | data[i];
+		mark_dirty(1u << terminal_row);
+
+		data += n;
+		size -= n;
+		terminal_column += n;
+		if (terminal_column == VGA_WIDTH)
+			terminal_newline();
 	}
 }
 
+/* Runs of printable characters go in bulk, control characters one by one */
 void terminal_write(const char* data, size_t size) {
-	for (size_t i = 0; i < size; i++)
-		terminal_putchar(data[i]);
+	const unsigned char* p = (const unsigned char*) data;
+	const unsigned char* end = p + size;
+
+	terminal_follow();
+	while (p < end) {
+		if (*p < ' ') {
+			terminal_putchar(*p++);
+			continue;
+		}
+
+		const unsigned char* run = p;
+		while (p < end && *p >= ' ')
+			p++;
+		terminal_write_run(run, p - run);
+	}
 }
 
 void terminal_writestring(const char* data) {
@@ -131,6 +342,8 @@ void splash_screen() {
     const char* d;
     const char* msg;
 
+    console_lock();
+
     // print border
     d = "=";
     for (int i = 0; i < VGA_WIDTH; i++) 
@@ -198,18 +411,160 @@ void splash_screen() {
     while (loading_bar_index < loading_bar_time) {
         terminal_writestring((const char *)"* ");
         loading_bar_index += 100;
+        console_unlock();
         timer_wait(25);
+        console_lock();
     }
 
     terminal_clear();
+    console_unlock();
 }
 
 // TODO, read PS1 from a shell config when implemented. (need VFS)
 void terminal_prompt(const char *usr, const char *device_name, const char *curr_dir) {
+    console_lock();
     terminal_writestring((const char *) usr);
     terminal_writestring((const char *)"@");
     terminal_writestring((const char *) device_name);
     terminal_writestring((const char *)" ");
     terminal_writestring((const char *) curr_dir);
     terminal_writestring((const char *)"$ ");
+    console_unlock();
+}
+
+/* ======== Scrollback benchmark ======== */
+
+#define SCROLL_BENCH_LINES 100000
+/* each linear line moves the whole history, ~1.6 MB: sample fewer */
+#define SCROLL_BENCH_LINEAR_LINES 100
+
+static uint16_t bench_screen[VGA_HEIGHT * VGA_WIDTH];
+static uint16_t (*bench_saved)[VGA_WIDTH];
+static size_t bench_top, bench_history;
+static size_t bench_row, bench_column;
+static void (*bench_draw_row)(size_t y, const uint16_t *cells);
+
+/*
+ * Point the screen at RAM, device emulation is not what is measured. The
+ * console lock keeps the log out of the screen in the meantime. The whole
+ * ring is saved, the benchmark goes round it many times.
+ */
+static int bench_begin(void) {
+	bench_saved = kmalloc(lines_count * sizeof(*lines));
+	if (!bench_saved)
+		return 0;
+	if (!console_trylock()) {
+		kfree(bench_saved);
+		return 0;
+	}
+
+	memcpy(bench_saved, lines, lines_count * sizeof(*lines));
+	bench_top = screen_top;
+	bench_history = history;
+	bench_row = terminal_row;
+	bench_column = terminal_column;
+	bench_draw_row = draw_row;
+	draw_row = vga_draw_row;
+	terminal_buffer = bench_screen;
+	return 1;
+}
+
+/* put the screen and its history back as they were */
+static void bench_end(void) {
+	terminal_buffer = VGA_MEMORY;
+	draw_row = bench_draw_row;
+	memcpy(lines, bench_saved, lines_count * sizeof(*lines));
+	kfree(bench_saved);
+	screen_top = bench_top;
+	history = bench_history;
+	view_offset = 0;
+	terminal_row = bench_row;
+	terminal_column = bench_column;
+	terminal_refresh();
+	console_unlock();
+}
+
+/*
+ * Cost per printed line of the ring, against keeping the same history in
+ * one linear buffer that is moved up by a line on every scroll.
+ */
+void terminal_scroll_bench(void) {
+	uint16_t* scratch = bench_screen;
+	if (lines == boot_lines || !bench_begin())
+		return;
+
+	unsigned long long start = rdtsc();
+	for (int i = 0; i < SCROLL_BENCH_LINES; i++)
+		terminal_write("scrollback benchmark line\n", 26);
+	unsigned int ring = (rdtsc() - start) / SCROLL_BENCH_LINES;
+
+	/* the same history as one flat array, scrolled with memmove */
+	uint16_t *flat = kmalloc(MAX_SCROLLBACK * VGA_WIDTH * sizeof(uint16_t));
+	unsigned int linear = 0;
+	if (flat) {
+		const size_t last = (MAX_SCROLLBACK - 1) * VGA_WIDTH;
+		memset(flat, 0, MAX_SCROLLBACK * VGA_WIDTH * sizeof(uint16_t));
+
+		start = rdtsc();
+		for (int i = 0; i < SCROLL_BENCH_LINEAR_LINES; i++) {
+			memmove(flat, flat + VGA_WIDTH, last * sizeof(uint16_t));
+			for (size_t x = 0; x < VGA_WIDTH; x++)
+				flat[last + x] = vga_entry(x < 25 ? "scrollback benchmark line"[x] : ' ', terminal_color);
+			memcpy(scratch, flat + (MAX_SCROLLBACK - VGA_HEIGHT) * VGA_WIDTH, sizeof(bench_screen));
+		}
+		linear = (rdtsc() - start) / SCROLL_BENCH_LINEAR_LINES;
+		kfree(flat);
+	}
+
+	bench_end();
+
+	printk(LOG_INFO, "tty: scrolling: ring %u cycles/line over %u lines, "
+	       "linear history %u cycles/line over %u lines\n",
+	       ring, SCROLL_BENCH_LINES, linear, SCROLL_BENCH_LINEAR_LINES);
+	bench_report("tty_scroll_ring", ring, "cycles");
+	bench_report("tty_scroll_linear", linear, "cycles");
+}
+
+#define WRITE_BENCH_ROUNDS 20000
+
+static const char write_bench_line[] =
+	"The quick brown fox jumps over the lazy dog, 0123456789 times.\n";
+
+/*
+ * Cycles per byte through the output path: a byte at a time as before,
+ * terminal_write with its bulk runs, and printf on top of it.
+ */
+void terminal_write_bench(void) {
+	const size_t len = sizeof(write_bench_line) - 1;
+	const size_t bytes = WRITE_BENCH_ROUNDS * len;
+	unsigned int cost[3];
+	if (!bench_begin())
+		return;
+
+	unsigned long long start = rdtsc();
+	for (int i = 0; i < WRITE_BENCH_ROUNDS; i++)
+		for (size_t j = 0; j < len; j++)
+			terminal_putchar(write_bench_line[j]);
+	cost[0] = (rdtsc() - start) / bytes;
+
+	start = rdtsc();
+	for (int i = 0; i < WRITE_BENCH_ROUNDS; i++)
+		terminal_write(write_bench_line, len);
+	cost[1] = (rdtsc() - start) / bytes;
+
+	/* printf takes the console lock itself, log lines may land on the bench screen */
+	console_unlock();
+	start = rdtsc();
+	for (int i = 0; i < WRITE_BENCH_ROUNDS; i++)
+		printf("%s", write_bench_line);
+	cost[2] = (rdtsc() - start) / bytes;
+	console_lock();
+
+	bench_end();
+
+	printk(LOG_INFO, "tty: cycles/byte: putchar %u, terminal_write %u, printf %u\n",
+	       cost[0], cost[1], cost[2]);
+	bench_report("tty_putchar", cost[0], "cycles/byte");
+	bench_report("tty_write", cost[1], "cycles/byte");
+	bench_report("tty_printf", cost[2], "cycles/byte");
 }
@@ -0,0 +1,574 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <slab.h>
+
+#include <kernel/vmm.h>
+#include <kernel/pmm.h>
+#include <kernel/system.h>
+#include <kernel/printk.h>
+#include <kernel/bench.h>
+
+/* lives in boot.S */
+extern uint32_t boot_page_directory[1024];
+extern uint32_t boot_page_table1[1024];
+
+/* linker.ld */
+extern char _kernel_text_start[];
+extern char _kernel_data_start[];
+extern char _kernel_end[];
+
+/* VMM_GLOBAL once the CPU is known to support it */
+static uint32_t vmm_global = 0;
+
+/* Freed heap ranges per order, reused before the heap grows any further */
+#define KHEAP_FREE_SLOTS 128
+
+static uint32_t kheap_top = KHEAP_START;
+static uint32_t kheap_free[PMM_MAX_ORDER + 1][KHEAP_FREE_SLOTS];
+static unsigned int kheap_free_count[PMM_MAX_ORDER + 1];
+
+/* Device mappings are never taken down, the window only grows, except
+ * for a mapping that failed halfway and was still the last one */
+static uint32_t kmmio_top = KMMIO_START;
+
+/* A kernel page for reaching frames mapped nowhere else: the page tables
+ * of a space that is not loaded, a copy in the making. Interrupts off */
+static uint32_t vmm_scratch = 0;
+static uint32_t *vmm_scratch_pte;
+
+/* The boot directory, master of the kernel half, and the space in cr3 */
+static struct vmm_space kernel_space = { boot_page_directory, 0, 0 };
+static struct vmm_space *current_space = &kernel_space;
+static unsigned int vmm_kernel_gen = 0;
+
+/* Entry for 'virt' in its page table, allocating the table if asked to */
+static uint32_t *vmm_get_pte(uint32_t virt, int create)
+{
+    uint32_t *pde = &VMM_PAGE_DIRECTORY[virt >> 22];
+
+    if (!(*pde & VMM_PRESENT))
+    {
+        if (!create)
+            return 0;
+
+        uint32_t frame = pmm_alloc_frame();
+        if (!frame)
+            return 0;
+
+        /* user access is decided per page, let the directory allow it */
+        *pde = frame | VMM_PRESENT | VMM_WRITE | (virt < KERNEL_VIRTUAL_BASE ? VMM_USER : 0);
+
+        /* the new table shows up in the recursive window, clear it there */
+        uint32_t table = (uint32_t) &VMM_PAGE_TABLES[(virt >> 22) << 10];
+        invlpg(table);
+        memset((void *) table, 0, PAGE_SIZE);
+
+        /* kernel tables are shared, the other address spaces copy them from the master */
+        if (virt >= KERNEL_VIRTUAL_BASE)
+        {
+            boot_page_directory[virt >> 22] = *pde;
+            vmm_kernel_gen++;
+        }
+    }
+
+    return &VMM_PAGE_TABLES[virt >> 12];
+}
+
+int vmm_map(uint32_t virt, uint32_t phys, uint32_t flags)
+{
+    unsigned int irq = irq_save();
+    uint32_t *pte = vmm_get_pte(virt, 1);
+
+    if (pte)
+    {
+        *pte = (phys & ~0xFFF) | (flags & 0xFFF & ~VMM_LAZY) | VMM_PRESENT;
+        invlpg(virt);
+    }
+    irq_restore(irq);
+    return pte ? 0 : -1;
+}
+
+/* Returns the frame that was mapped, 0 if there was none */
+uint32_t vmm_unmap(uint32_t virt)
+{
+    unsigned int irq = irq_save();
+    uint32_t *pte = vmm_get_pte(virt, 0);
+    uint32_t phys = 0;
+
+    if (pte)
+    {
+        phys = (*pte & VMM_PRESENT) ? (*pte & ~0xFFF) : 0;
+        *pte = 0;
+        if (phys)
+            invlpg(virt);
+    }
+    irq_restore(irq);
+    return phys;
+}
+
+int vmm_protect(uint32_t virt, uint32_t flags)
+{
+    unsigned int irq = irq_save();
+    uint32_t *pte = vmm_get_pte(virt, 0);
+    int ret = -1;
+
+    if (pte && (*pte & VMM_PRESENT))
+    {
+        *pte = (*pte & ~0xFFF) | (flags & 0xFFF & ~VMM_LAZY) | VMM_PRESENT;
+        invlpg(virt);
+        ret = 0;
+    }
+    else if (pte && (*pte & VMM_LAZY))
+    {
+        *pte = (flags & 0xFFF & ~VMM_PRESENT) | VMM_LAZY;
+        ret = 0;
+    }
+    irq_restore(irq);
+    return ret;
+}
+
+/* Reserve a page to be backed by a zeroed frame on first touch */
+int vmm_reserve(uint32_t virt, uint32_t flags)
+{
+    unsigned int irq = irq_save();
+    uint32_t *pte = vmm_get_pte(virt, 1);
+
+    /* not present, so nothing of it can be in the TLB */
+    if (pte)
+        *pte = (flags & 0xFFF & ~VMM_PRESENT) | VMM_LAZY;
+    irq_restore(irq);
+    return pte ? 0 : -1;
+}
+
+uint32_t vmm_translate(uint32_t virt)
+{
+    uint32_t *pte = vmm_get_pte(virt, 0);
+
+    if (!pte || !(*pte & VMM_PRESENT))
+        return 0;
+    return (*pte & ~0xFFF) | (virt & 0xFFF);
+}
+
+/* Called from the #PF handler, returns 1 when the fault was resolved */
+int vmm_page_fault(uint32_t addr, uint32_t err)
+{
+    if (err & VMM_FAULT_PRESENT)
+        return 0;
+
+    uint32_t *pte = vmm_get_pte(addr, 0);
+    if (!pte || !(*pte & VMM_LAZY))
+        return 0;
+
+    uint32_t frame = pmm_alloc_frame();
+    if (!frame)
+        panic("vmm: out of memory");
+
+    uint32_t page = addr & ~0xFFF;
+    uint32_t flags = (*pte & 0xFFF & ~VMM_LAZY) | VMM_PRESENT;
+
+    /* with CR0.WP a read-only page is cleared before it becomes one */
+    *pte = frame | flags | VMM_WRITE;
+    invlpg(page);
+    memset((void *) page, 0, PAGE_SIZE);
+    if (!(flags & VMM_WRITE))
+    {
+        *pte = frame | flags;
+        invlpg(page);
+    }
+    return 1;
+}
+
+static void *vmm_scratch_map(uint32_t frame)
+{
+    *vmm_scratch_pte = frame | VMM_PRESENT | VMM_WRITE;
+    invlpg(vmm_scratch);
+    return (void *) vmm_scratch;
+}
+
+int vmm_copy_on_write(uint32_t addr)
+{
+    unsigned int irq = irq_save();
+    uint32_t *pte = vmm_get_pte(addr, 0);
+    int ret = 0;
+
+    if (pte && (*pte & (VMM_PRESENT | VMM_COW)) == (VMM_PRESENT | VMM_COW))
+    {
+        uint32_t page = addr & ~0xFFF;
+        uint32_t frame = *pte & ~0xFFF;
+
+        /* the last one left with the frame just takes it back */
+        if (pmm_frame_refs(frame) > 1)
+        {
+            uint32_t copy = pmm_alloc_frame();
+            if (!copy)
+            {
+                irq_restore(irq);
+                return 0;
+            }
+            memcpy(vmm_scratch_map(copy), (void *) page, PAGE_SIZE);
+            pmm_free_frame(frame);
+            frame = copy;
+        }
+
+        *pte = frame | (*pte & 0xFFF & ~VMM_COW) | VMM_WRITE;
+        invlpg(page);
+        ret = 1;
+    }
+    irq_restore(irq);
+    return ret;
+}
+
+/* ======== Address spaces ======== */
+
+struct vmm_space *vmm_space_create()
+{
+    struct vmm_space *space = kmalloc(sizeof(*space));
+    uint32_t *dir = kpage_alloc(0);
+
+    if (!space || !dir)
+    {
+        kfree(space);
+        if (dir)
+            kpage_free(dir, 0);
+        return 0;
+    }
+
+    /* faults the heap page in, vmm_translate finds a frame after this */
+    memset(dir, 0, VMM_KERNEL_PDE * sizeof(uint32_t));
+
+    unsigned int irq = irq_save();
+    memcpy(&dir[VMM_KERNEL_PDE], &boot_page_directory[VMM_KERNEL_PDE],
+           (VMM_SELF_PDE - VMM_KERNEL_PDE) * sizeof(uint32_t));
+    space->kernel_gen = vmm_kernel_gen;
+    irq_restore(irq);
+
+    space->directory = dir;
+    space->phys = vmm_translate((uint32_t) dir);
+    dir[VMM_SELF_PDE] = space->phys | VMM_PRESENT | VMM_WRITE;
+    return space;
+}
+
+/*
+ * A loaded space is emptied through the recursive window, with interrupts
+ * off to stay on it, any other one table at a time through the scratch
+ * page. Frames shared with another space only lose a reference.
+ */
+void vmm_space_destroy(struct vmm_space *space)
+{
+    unsigned int irq = irq_save();
+    int loaded = space == current_space;
+
+    for (uint32_t i = 0; i < VMM_KERNEL_PDE; i++)
+    {
+        uint32_t pde = loaded ? VMM_PAGE_DIRECTORY[i] : space->directory[i];
+        if (!(pde & VMM_PRESENT))
+            continue;
+
+        uint32_t *table = loaded ? &VMM_PAGE_TABLES[i << 10] : vmm_scratch_map(pde & ~0xFFF);
+        for (uint32_t j = 0; j < 1024; j++)
+            if (table[j] & VMM_PRESENT)
+                pmm_free_frame(table[j] & ~0xFFF);
+        pmm_free_frame(pde & ~0xFFF);
+    }
+    if (loaded)
+        vmm_switch(0);
+    irq_restore(irq);
+
+    kpage_free(space->directory, 0);
+    kfree(space);
+}
+
+/*
+ * Every user table of the current space is copied, every frame in it
+ * gains a reference, and what was writable turns VMM_COW on both sides.
+ * Lazy entries are copied as they are: each space faults in its own.
+ */
+struct vmm_space *vmm_space_fork()
+{
+    struct vmm_space *space = vmm_space_create();
+    if (!space)
+        return 0;
+
+    unsigned int irq = irq_save();
+    int failed = 0;
+
+    for (uint32_t i = 0; i < VMM_KERNEL_PDE && !failed; i++)
+    {
+        uint32_t pde = VMM_PAGE_DIRECTORY[i];
+        if (!(pde & VMM_PRESENT))
+            continue;
+
+        uint32_t frame = pmm_alloc_frame();
+        if (!frame)
+        {
+            failed = 1;
+            break;
+        }
+
+        uint32_t *table = &VMM_PAGE_TABLES[i << 10];
+        uint32_t *copy = vmm_scratch_map(frame);
+        for (uint32_t j = 0; j < 1024; j++)
+        {
+            uint32_t pte = table[j];
+
+            if ((pte & VMM_PRESENT) && !failed && pmm_frame_ref(pte & ~0xFFF))
+                failed = 1;
+            if (failed)
+            {
+                copy[j] = 0;
+                continue;
+            }
+            if ((pte & VMM_PRESENT) && (pte & VMM_WRITE))
+                table[j] = pte = (pte & ~VMM_WRITE) | VMM_COW;
+            copy[j] = pte;
+        }
+        space->directory[i] = frame | (pde & 0xFFF);
+    }
+
+    /* entries that just lost VMM_WRITE may still be in the TLB */
+    write_cr3(read_cr3());
+    irq_restore(irq);
+
+    if (failed)
+    {
+        vmm_space_destroy(space);
+        return 0;
+    }
+    return space;
+}
+
+void vmm_switch(struct vmm_space *space)
+{
+    if (!space)
+        space = &kernel_space;
+    if (space == current_space)
+        return;
+
+    /* kernel tables added since this space was last loaded */
+    if (space != &kernel_space && space->kernel_gen != vmm_kernel_gen)
+    {
+        memcpy(&space->directory[VMM_KERNEL_PDE], &boot_page_directory[VMM_KERNEL_PDE],
+               (VMM_SELF_PDE - VMM_KERNEL_PDE) * sizeof(uint32_t));
+        space->kernel_gen = vmm_kernel_gen;
+    }
+
+    current_space = space;
+    write_cr3(space->phys);
+}
+
+/* ======== Kernel heap ======== */
+
+/* Virtual range of 2^order pages, aligned to its own size */
+static uint32_t kheap_reserve(unsigned int order)
+{
+    uint32_t size = PAGE_SIZE << order;
+
+    if (kheap_free_count[order])
+        return kheap_free[order][--kheap_free_count[order]];
+
+    uint32_t virt = (kheap_top + size - 1) & ~(size - 1);
+    if (virt < kheap_top || virt + size > KHEAP_END)
+        return 0;
+    kheap_top = virt + size;
+    return virt;
+}
+
+/*
+ * Page blocks for the libk slab allocator. Only the address range is taken
+ * here, frames are faulted in as the pages get used.
+ */
+void *kpage_alloc(unsigned int order)
+{
+    if (order > PMM_MAX_ORDER)
+        return 0;
+
+    unsigned int irq = irq_save();
+    uint32_t virt = kheap_reserve(order);
+    irq_restore(irq);
+    if (!virt)
+        return 0;
+
+    for (uint32_t i = 0; i < (1u << order); i++)
+    {
+        if (vmm_reserve(virt + i * PAGE_SIZE, VMM_WRITE))
+        {
+            kpage_free((void *) virt, order);
+            return 0;
+        }
+    }
+    return (void *) virt;
+}
+
+void kpage_free(void *addr, unsigned int order)
+{
+    uint32_t virt = (uint32_t) addr;
+
+    for (uint32_t i = 0; i < (1u << order); i++)
+    {
+        uint32_t frame = vmm_unmap(virt + i * PAGE_SIZE);
+        if (frame)
+            pmm_free_frame(frame);
+    }
+
+    /* when the list is full the address range is simply never reused */
+    unsigned int irq = irq_save();
+    if (kheap_free_count[order] < KHEAP_FREE_SLOTS)
+        kheap_free[order][kheap_free_count[order]++] = virt;
+    irq_restore(irq);
+}
+
+/* ======== Device memory ======== */
+
+/* Map 'size' bytes at physical 'phys' into the window with 'flags' */
+static void *vmm_map_window(uint32_t phys, uint32_t size, uint32_t flags)
+{
+    uint32_t offset = phys & (PAGE_SIZE - 1);
+    uint32_t pages = (offset + size + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    unsigned int irq = irq_save();
+    uint32_t virt = kmmio_top;
+    if (pages > (KMMIO_END - virt) / PAGE_SIZE)
+    {
+        irq_restore(irq);
+        return 0;
+    }
+    kmmio_top += pages * PAGE_SIZE;
+    irq_restore(irq);
+
+    for (uint32_t i = 0; i < pages; i++)
+    {
+        if (vmm_map(virt + i * PAGE_SIZE, (phys - offset) + i * PAGE_SIZE, flags | vmm_global))
+        {
+            /* the frames are not ours to free, only the mappings go */
+            while (i--)
+                vmm_unmap(virt + i * PAGE_SIZE);
+
+            irq = irq_save();
+            if (kmmio_top == virt + pages * PAGE_SIZE)
+                kmmio_top = virt;
+            irq_restore(irq);
+            return 0;
+        }
+    }
+    return (void *) (virt + offset);
+}
+
+/*
+ * Map 'size' bytes of device memory at physical 'phys' into the kernel.
+ * The frames are not the PMM's, they are never allocated or freed.
+ * Caching is left to the MTRRs, which firmware sets to write-combining
+ * for framebuffers where it can.
+ */
+void *vmm_map_mmio(uint32_t phys, uint32_t size)
+{
+    return vmm_map_window(phys, size, VMM_WRITE);
+}
+
+/* Memory the bootloader loaded, such as a module. Reserved in the PMM
+ * from boot, mapped read-only for good */
+const void *vmm_map_boot(uint32_t phys, uint32_t size)
+{
+    return vmm_map_window(phys, size, 0);
+}
+
+/* ======== Kernel image ======== */
+
+/* .text and .rodata are read-only, everything else in the image is not */
+static uint32_t kernel_page_flags(uint32_t virt)
+{
+    if (virt >= (uint32_t) _kernel_text_start && virt < (uint32_t) _kernel_data_start)
+        return VMM_PRESENT | vmm_global;
+    return VMM_PRESENT | VMM_WRITE | vmm_global;
+}
+
+/*
+ * Remap the kernel image as set up by boot.S, with 4 KiB pages split at the
+ * section boundaries. With PGE, every kernel entry is global and survives
+ * address-space switches.
+ *
+ * There are no 4 MiB (PSE) pages: the image shares its one 4 MiB region
+ * with low memory, and read-only .text/.rodata with writable .data/.bss,
+ * so no large page could keep the section permissions.
+ */
+static void vmm_map_kernel()
+{
+    for (uint32_t i = 0; i < 1024; i++)
+    {
+        uint32_t virt = KERNEL_VIRTUAL_BASE + i * PAGE_SIZE;
+        boot_page_table1[i] = (virt - KERNEL_VIRTUAL_BASE) | kernel_page_flags(virt);
+    }
+
+    /* Nothing is global yet, one reload drops every stale entry */
+    write_cr3(read_cr3());
+}
+
+/* Take over the boot page directory, make it recursive, remap the kernel */
+void vmm_init()
+{
+    uint32_t pd_phys = (uint32_t) boot_page_directory - KERNEL_VIRTUAL_BASE;
+    unsigned int eax, ebx, ecx, edx;
+
+    boot_page_directory[VMM_SELF_PDE] = pd_phys | VMM_PRESENT | VMM_WRITE;
+    kernel_space.phys = pd_phys;
+    invlpg((uint32_t) VMM_PAGE_DIRECTORY);
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (edx & CPUID_FEAT_EDX_PGE)
+        vmm_global = VMM_GLOBAL;
+
+    vmm_map_kernel();
+
+    if (vmm_global)
+        write_cr4(read_cr4() | CR4_PGE);
+
+    vmm_scratch = kheap_reserve(0);
+    vmm_scratch_pte = vmm_get_pte(vmm_scratch, 1);
+    if (!vmm_scratch_pte)
+        panic("vmm: out of memory");
+}
+
+/* ======== TLB benchmark ======== */
+
+#define TLB_BENCH_ROUNDS 256
+
+/* Reload cr3, then touch every page of the kernel image once */
+static unsigned int tlb_bench_run()
+{
+    uint32_t cr3 = read_cr3();
+    unsigned int sum = 0;
+    unsigned long long start = rdtsc();
+
+    for (int i = 0; i < TLB_BENCH_ROUNDS; i++)
+    {
+        write_cr3(cr3);
+        for (uint32_t v = (uint32_t) _kernel_text_start; v < (uint32_t) _kernel_end; v += PAGE_SIZE)
+            sum += *(volatile unsigned char *) v;
+    }
+
+    (void) sum;
+    return (rdtsc() - start) / TLB_BENCH_ROUNDS;
+}
+
+/*
+ * Cost of an address-space switch followed by kernel work, with the kernel
+ * entries global and again with PGE turned off (so they are flushed too).
+ */
+void vmm_tlb_bench()
+{
+    if (!vmm_global)
+    {
+        printk(LOG_NOTICE, "vmm: no PGE, tlb bench skipped\n");
+        return;
+    }
+
+    unsigned int global = tlb_bench_run();
+    write_cr4(read_cr4() & ~CR4_PGE);
+    unsigned int flushed = tlb_bench_run();
+    write_cr4(read_cr4() | CR4_PGE);
+
+    printk(LOG_INFO, "vmm: cr3 reload + %u kernel pages: %u cycles global, %u cycles non-global\n",
+           ((uint32_t) _kernel_end - (uint32_t) _kernel_text_start) / PAGE_SIZE, global, flushed);
+    bench_report("vmm_cr3_global", global, "cycles");
+    bench_report("vmm_cr3_flushed", flushed, "cycles");
+}
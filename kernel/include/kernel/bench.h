@@ -0,0 +1,39 @@
+#ifndef _KERNEL_BENCH_H
+#define _KERNEL_BENCH_H
+
+#include <stdint.h>
+
+#include <kernel/multiboot.h>
+
+/* ======== Benchmark mode ======== */
+/*
+ * "bench" on the multiboot command line makes kernel_main run the
+ * benchmark suite instead of the usual boot, then leave QEMU through the
+ * isa-debug-exit device (see bench.sh). "bench=memcpy,tty" runs only the
+ * benchmarks whose names start with one of the given words.
+ *
+ * Each benchmark prints its figures for people as always and, in this
+ * mode, one line per figure for scripts:
+ *
+ *     BENCH <name> <value> <unit>
+ *
+ * The lines go through printk, on COM1 they follow the timestamp.
+ */
+
+/* Read the command line, before pmm_init() while it is still mapped */
+void bench_init(struct multiboot_info *mbi);
+
+int bench_mode(void);
+
+/* One result line, printed only in benchmark mode */
+void bench_report(const char *name, uint64_t value, const char *unit);
+
+/* Run the suite, print everything and exit QEMU */
+void bench_run(void);
+
+/* QEMU's isa-debug-exit device, its exit status is (code << 1) | 1 */
+#define QEMU_EXIT_PORT 0xF4
+
+void qemu_exit(unsigned int code);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef _KERNEL_CLOCK_H
+#define _KERNEL_CLOCK_H
+
+#include <stdint.h>
+
+/* ======== Monotonic clock ======== */
+/*
+ * Nanoseconds since clock_init(), read from the TSC. The TSC rate is
+ * measured once against PIT channel 2 and cycles are converted with one
+ * multiply and shift:
+ *
+ *     ns = cycles * clock_mult >> clock_shift
+ *
+ * done in two 32-bit halves so the product never overflows. Without a TSC
+ * the PIT channel 0 countdown is the clock, at ~1 us resolution and the
+ * cost of a few port reads.
+ */
+
+void clock_init();
+
+uint64_t clock_monotonic_ns();
+
+/* TSC cycles, e.g. a difference of two rdtsc() reads, to nanoseconds */
+uint64_t clock_cycles_to_ns(uint64_t cycles);
+
+/* Measured TSC rate, 0 if the clock runs from the PIT */
+uint32_t clock_tsc_khz();
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef _KERNEL_ELF_H
+#define _KERNEL_ELF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/process.h>
+
+/* ======== ELF32 program loader ======== */
+/*
+ * Loads statically linked i386 executables (ET_EXEC). Loading maps
+ * nothing: each PT_LOAD segment becomes a process area, and the page
+ * fault handler copies a page out of the image the first time it is
+ * touched. What the program never reads costs nothing at startup.
+ *
+ * The image is not copied, it must stay in memory as long as a process
+ * runs from it.
+ */
+
+#define ELF_MAGIC 0x464C457F    /* "\x7FELF" read as a little endian word */
+
+#define ELFCLASS32  1
+#define ELFDATA2LSB 1
+#define EV_CURRENT  1
+#define ET_EXEC     2
+#define EM_386      3
+
+#define PT_LOAD 1
+
+#define PF_X 0x1
+#define PF_W 0x2
+#define PF_R 0x4
+
+struct elf32_header
+{
+    uint32_t magic;
+    uint8_t class;
+    uint8_t data;
+    uint8_t ident_version;
+    uint8_t ident_pad[9];
+
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint32_t entry;
+    uint32_t phoff;             /* program header table, from the file's start */
+    uint32_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} __attribute__((packed));
+
+struct elf32_program_header
+{
+    uint32_t type;
+    uint32_t offset;            /* in the file */
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t filesz;            /* bytes from the file, the rest up to memsz is zeroed */
+    uint32_t memsz;
+    uint32_t flags;
+    uint32_t align;
+} __attribute__((packed));
+
+/* User stack, grown a page at a time by faults below its top */
+#define USER_STACK_TOP KERNEL_VIRTUAL_BASE
+#define USER_STACK_MAX 0x00800000
+
+/* Add the segments of 'image' to the current process, returns 0 or -1 */
+int elf_load(struct process *p, const void *image, size_t size, uint32_t *entry);
+
+/* Start a process running 'image', returns its pid or -1 */
+int elf_exec(const char *name, const void *image, size_t size);
+
+/* Time from elf_exec to exit, for a small image and a 4 MiB one */
+void elf_bench();
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef _KERNEL_FBCON_H
+#define _KERNEL_FBCON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/multiboot.h>
+
+/* ======== Framebuffer console ======== */
+/*
+ * Draws the terminal's grid of text cells (character | attribute << 8, as
+ * in VGA text memory) on the linear framebuffer that boot.S asks the
+ * bootloader for: RGB at 32, 24 or 16 bpp. The grid is centred on the screen.
+ *
+ * Glyphs come from an 8x8 font drawn 8x16. A glyph is expanded to pixels
+ * in its colours the first time it is drawn and kept in a small cache, so
+ * drawing a cell is sixteen 32-byte row copies. Cells are drawn into a back
+ * buffer in RAM at 32 bits a pixel; each row remembers what it last drew, and
+ * only the span of cells that changed is copied out, in the framebuffer's
+ * own pixel size.
+ */
+
+#define FBCON_GLYPH_WIDTH  8
+#define FBCON_GLYPH_HEIGHT 16
+
+/*
+ * Returns 0 when there is no usable framebuffer, text mode then stays on.
+ * A graphics mode it cannot draw on gets a warning, which reaches serial.
+ */
+int fbcon_init(struct multiboot_info *mbi, size_t cols, size_t rows);
+void fbcon_draw_row(size_t y, const uint16_t *cells);
+
+/* Glyph and framebuffer copy throughput */
+void fbcon_blit_bench(void);
+
+#endif
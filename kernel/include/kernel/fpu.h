@@ -0,0 +1,72 @@
+#ifndef _KERNEL_FPU_H
+#define _KERNEL_FPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ======== FPU and SSE ======== */
+/*
+ * fpu_init() turns on the x87 FPU and, when CPUID reports FXSR and SSE2,
+ * the SSE state (CR4.OSFXSR) so that XMM registers can be used.
+ *
+ * Threads get the FPU lazily. The registers hold the state of one thread,
+ * the owner. Switching to any other thread sets CR0.TS, and its first FPU
+ * instruction raises #NM: fpu_trap() saves the owner's state, loads the
+ * new thread's (a clean one the first time) and makes it the owner. A
+ * thread that never touches the FPU never has anything saved or loaded,
+ * and one that runs alone keeps its registers across switches.
+ *
+ * The kernel itself is built without SSE; code that wants the XMM
+ * registers brackets their use with kernel_fpu_begin() and
+ * kernel_fpu_end(). These disable interrupts and save the owner's state
+ * first, after which nobody owns the registers and the next user traps.
+ * Sections must stay short: interrupts are off throughout.
+ */
+
+#define CR0_MP 0x02                 /* wait honours TS */
+#define CR0_EM 0x04                 /* no FPU, x87 instructions trap */
+#define CR0_TS 0x08                 /* FPU state belongs to someone else */
+
+#define CR4_OSFXSR     0x200        /* fxsave/fxrstor and SSE enabled */
+#define CR4_OSXMMEXCPT 0x400        /* unmasked SSE exceptions raise #XM */
+
+/* memcpy and memset switch to SSE2 from this size, and work in chunks */
+#define FPU_COPY_MIN   (64 * 1024)
+#define FPU_COPY_CHUNK (64 * 1024)
+
+/* Set by fpu_init() when the SSE2 paths may be taken */
+extern int fpu_sse2;
+
+void fpu_init(void);
+
+struct thread;
+
+/* Called by schedule() for the thread about to run */
+void fpu_switch(struct thread *next);
+/* #NM: give the FPU to the running thread */
+void fpu_trap(void);
+/* A thread is going away, forget its state */
+void fpu_release(struct thread *t);
+
+/* A copy of the running thread's FPU state, 0 if it never used the FPU */
+void *fpu_clone(void);
+/* Make a copy from fpu_clone() the running thread's state */
+void fpu_adopt(void *state);
+/* Free a copy nobody adopted */
+void fpu_discard(void *state);
+
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+/*
+ * Copy or fill the leading multiple of 64 bytes of 'size' with SSE2
+ * non-temporal stores, returning how much was done. 'dst' must be 16-byte
+ * aligned. Only when fpu_sse2 is set.
+ */
+size_t fpu_copy(void *dst, const void *src, size_t size);
+size_t fpu_fill(void *dst, uint32_t pattern, size_t size);
+
+/* memcpy/memset sizes 1 B to 1 MiB against byte loops */
+void memcpy_bench(void);
+
+#endif
@@ -26,12 +26,45 @@ struct gdt_entry
     unsigned char base_high;
 } __attribute__((packed)); //packed prevents compiler optimizations. 
 
+/*
+ * Task State Segment. Only ss0:esp0 is used, the stack the CPU switches to
+ * when an interrupt or int $0x80 arrives from ring 3. The I/O bitmap
+ * offset points past the end, so user mode gets no ports.
+ */
+struct tss_entry
+{
+    unsigned int prev_tss;
+    unsigned int esp0, ss0;
+    unsigned int esp1, ss1;
+    unsigned int esp2, ss2;
+    unsigned int cr3, eip, eflags;
+    unsigned int eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    unsigned int es, cs, ss, ds, fs, gs;
+    unsigned int ldt;
+    unsigned short trap, iomap_base;
+} __attribute__((packed));
+
 struct gdt_ptr
 {
     unsigned short limit; // size of the gdt - 1
     unsigned int base; // linear address of the gdt
 } __attribute__((packed));
 
+/*
+ * Selectors. SYSENTER and SYSEXIT take the kernel code selector from an
+ * MSR and find the others at fixed offsets from it, so the order of the
+ * first four matters: kernel code, kernel data, user code, user data.
+ */
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_USER_CODE   0x1B    /* RPL 3 */
+#define GDT_USER_DATA   0x23
+#define GDT_TSS         0x28
+
+#define GDT_ENTRIES 6
+
+extern struct tss_entry tss;
+
 /* asm routine lives in boot.S */
 extern void gdt_flush();
 
@@ -39,4 +72,10 @@ void gdt_set_gate(int num, unsigned long base, unsigned long limit, unsigned cha
 
 void gdt_install();
 
+/* Stack for entering the kernel from ring 3, the top of the running thread's */
+static inline void tss_set_kernel_stack(unsigned int esp0)
+{
+    tss.esp0 = esp0;
+}
+
 #endif
@@ -34,4 +34,32 @@ void irq_remap(void);
 void irq_install();
 void irq_handler(struct regs *r);
 
+/* ======== Deferred work (softirqs) ======== */
+/*
+ * A handler does the minimum with interrupts off (read the device, ACK it)
+ * and raises a softirq for the rest. Pending softirqs run at IRQ exit, after
+ * the EOI and with interrupts enabled, on the stack of whatever thread was
+ * interrupted; they may not sleep. Softirqs raised outside an interrupt, or
+ * still pending after SOFTIRQ_ROUNDS passes, run in the softirqd thread.
+ */
+
+#define SOFTIRQ_KEYBOARD 0
+#define SOFTIRQ_TTY      1
+#define SOFTIRQ_PRINTK   2
+#define SOFTIRQ_MAX      8
+
+#define SOFTIRQ_ROUNDS   4
+
+void softirq_register(unsigned int nr, const char *name, void (*handler)());
+void softirq_raise(unsigned int nr);
+
+/* Start softirqd, needs the scheduler */
+void softirq_init();
+
+/* Per-IRQ handler time and deferred work, per-softirq run time */
+void irq_stats();
+
+/* Cycles to take an interrupt and return from it */
+void irq_roundtrip_bench();
+
 #endif
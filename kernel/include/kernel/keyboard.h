@@ -1,9 +1,24 @@
 #ifndef _KERNEL_KEYBOARD_H
 #define _KERNEL_KEYBOARD_H
 
+#include <stddef.h>
 #include <kernel/system.h>
 
+/* Modifier state, see kbd_get_modifiers() */
+#define KBD_SHIFT    0x1
+#define KBD_CTRL     0x2
+#define KBD_ALT      0x4
+#define KBD_CAPSLOCK 0x8
+
+/* Decoded keys with no ASCII code */
+#define KEY_PAGE_UP   0x80
+#define KEY_PAGE_DOWN 0x81
+
 void keyboard_handler(struct regs *r);
 void keyboard_install();
 
+/* Block until input arrives, then return up to 'len' characters */
+size_t kbd_read(char *buf, size_t len);
+unsigned int kbd_get_modifiers();
+
 #endif
@@ -0,0 +1,94 @@
+#ifndef _KERNEL_MULTIBOOT_H
+#define _KERNEL_MULTIBOOT_H
+
+#include <stdint.h>
+
+/* ======== Multiboot ======== */
+/*
+ * Structures handed to the kernel by a Multiboot (version 1) compliant
+ * bootloader. GRUB leaves the magic value in eax and the physical address
+ * of the info structure in ebx, boot.S passes both on to kernel_main.
+ *
+ * Only the fields flagged in 'flags' are valid.
+ */
+
+#define MULTIBOOT_BOOTLOADER_MAGIC      0x2BADB002
+
+#define MULTIBOOT_INFO_MEMORY           0x00000001
+#define MULTIBOOT_INFO_BOOTDEV          0x00000002
+#define MULTIBOOT_INFO_CMDLINE          0x00000004
+#define MULTIBOOT_INFO_MODS             0x00000008
+#define MULTIBOOT_INFO_MEM_MAP          0x00000040
+#define MULTIBOOT_INFO_FRAMEBUFFER_INFO 0x00001000
+
+#define MULTIBOOT_MEMORY_AVAILABLE      1
+#define MULTIBOOT_MEMORY_RESERVED       2
+
+#define MULTIBOOT_FRAMEBUFFER_TYPE_INDEXED  0
+#define MULTIBOOT_FRAMEBUFFER_TYPE_RGB      1
+#define MULTIBOOT_FRAMEBUFFER_TYPE_EGA_TEXT 2
+
+struct multiboot_info
+{
+    uint32_t flags;
+
+    /* MULTIBOOT_INFO_MEMORY: KiB of lower and upper memory */
+    uint32_t mem_lower;
+    uint32_t mem_upper;
+
+    uint32_t boot_device;
+    uint32_t cmdline;
+
+    /* MULTIBOOT_INFO_MODS */
+    uint32_t mods_count;
+    uint32_t mods_addr;
+
+    /* a.out symbol table or ELF section header table */
+    uint32_t syms[4];
+
+    /* MULTIBOOT_INFO_MEM_MAP */
+    uint32_t mmap_length;
+    uint32_t mmap_addr;
+
+    uint32_t drives_length;
+    uint32_t drives_addr;
+    uint32_t config_table;
+    uint32_t boot_loader_name;
+    uint32_t apm_table;
+
+    uint32_t vbe_control_info;
+    uint32_t vbe_mode_info;
+    uint16_t vbe_mode;
+    uint16_t vbe_interface_seg;
+    uint16_t vbe_interface_off;
+    uint16_t vbe_interface_len;
+
+    /* MULTIBOOT_INFO_FRAMEBUFFER_INFO */
+    uint64_t framebuffer_addr;
+    uint32_t framebuffer_pitch;
+    uint32_t framebuffer_width;
+    uint32_t framebuffer_height;
+    uint8_t framebuffer_bpp;
+    uint8_t framebuffer_type;
+    /* TYPE_RGB: bit position and width of red, green and blue, in pairs */
+    uint8_t color_info[6];
+} __attribute__((packed));
+
+/* 'size' does not count itself, the next entry lives at addr + size + 4 */
+struct multiboot_mmap_entry
+{
+    uint32_t size;
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;
+} __attribute__((packed));
+
+struct multiboot_mod_list
+{
+    uint32_t mod_start;
+    uint32_t mod_end;
+    uint32_t cmdline;
+    uint32_t pad;
+} __attribute__((packed));
+
+#endif
@@ -2,6 +2,7 @@
 #define _KERNEL_PIT_H
 
 #include <kernel/system.h>
+#include <kernel/timer.h>
 
 /* ======== Programmable Interval Timer (PIT) ======== */
 /*
@@ -26,12 +27,26 @@
  *   1 = 4x BCD decay counter
  */
 
-void timer_phase(int hz);
+#define PIT_HZ 1193182
 
-void timer_wait(int ticks);
+#define PIT_CHANNEL0 0x40
+#define PIT_CHANNEL2 0x42
+#define PIT_COMMAND  0x43
+
+#define PIT_LATCH_CH0   0x00    /* counter 0, latch the current count */
+#define PIT_ONESHOT_CH0 0x30    /* counter 0, lo/hi byte, mode 0 */
+#define PIT_ONESHOT_CH2 0xB0    /* counter 2, lo/hi byte, mode 0 */
+
+/* Channel 2 is gated and read back through the speaker control port */
+#define PIT_GATE         0x61
+#define PIT_GATE_CH2     0x01
+#define PIT_GATE_SPEAKER 0x02
+#define PIT_GATE_OUT2    0x20
 
 void timer_handler(struct regs *r);
 
+uint64_t pit_clock_ns();
+
 void timer_install();
 
 #endif
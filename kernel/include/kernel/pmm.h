@@ -0,0 +1,65 @@
+#ifndef _KERNEL_PMM_H
+#define _KERNEL_PMM_H
+
+#include <stdint.h>
+#include <kernel/system.h>
+#include <kernel/multiboot.h>
+
+/* ======== Physical Memory Manager (PMM) ======== */
+/*
+ * Buddy allocator for 4 KiB physical page frames.
+ *
+ * A block of order n is 2^n contiguous frames, aligned to its own size.
+ * Free blocks of each order are tracked in a hierarchical bitmap (one bit
+ * per block, plus summary words saying which words below are non-empty),
+ * so finding a free block is a few bit scans instead of a linear walk.
+ * Allocation takes the lowest free block of the smallest order that fits.
+ *
+ * All addresses are physical. 0 is never a valid frame and is returned
+ * when the allocator runs out of memory.
+ *
+ * A single frame can be mapped in several places (copy-on-write pages
+ * after fork, shared program text). Each extra mapping takes a reference
+ * with pmm_frame_ref(), and pmm_free_frame() only drops one until the
+ * last. Frames nobody shared never touch the reference counts.
+ */
+
+#define PAGE_SIZE       4096
+#define PAGE_SHIFT      12
+
+/* largest block is 2^10 frames = 4 MiB */
+#define PMM_MAX_ORDER   10
+
+/* frames addressable by a 32 bit physical address (4 GiB) */
+#define PMM_MAX_FRAMES  (1 << 20)
+
+/*
+ * boot.S maps the first 4 MiB at KERNEL_VIRTUAL_BASE, physical memory below
+ * this limit can be touched through phys_to_virt().
+ */
+#define PMM_BOOT_WINDOW 0x00400000
+
+static inline void *phys_to_virt(uint32_t addr)
+{
+    return (void *) (addr + KERNEL_VIRTUAL_BASE);
+}
+
+void pmm_init(struct multiboot_info *mbi);
+
+uint32_t pmm_alloc_frames(unsigned int order);
+void pmm_free_frames(uint32_t addr, unsigned int order);
+
+uint32_t pmm_alloc_frame();
+void pmm_free_frame(uint32_t addr);
+
+/* Another mapping of a frame from pmm_alloc_frame(), returns 0 or -1 */
+int pmm_frame_ref(uint32_t addr);
+/* Mappings of a frame, 1 when it is not shared */
+unsigned int pmm_frame_refs(uint32_t addr);
+
+unsigned int pmm_free_count();
+unsigned int pmm_total_count();
+
+void pmm_selftest();
+
+#endif
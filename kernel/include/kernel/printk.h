@@ -0,0 +1,82 @@
+#ifndef _KERNEL_PRINTK_H
+#define _KERNEL_PRINTK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ======== Kernel log ======== */
+/*
+ * printk formats a message into a record of a fixed-size ring, stamped
+ * with clock_monotonic_ns() and a level, and returns. Writers claim a
+ * record with one atomic increment and never wait for each other or for
+ * output, so printk is safe from interrupt handlers. Once printk_init has
+ * run, the records are printed on the consoles from a softirq.
+ *
+ * Printing is serialised by the console lock. Whoever holds it prints every
+ * finished record, including ones logged meanwhile, before letting go.
+ * When writers lap the consoles, the oldest records are dropped and
+ * counted.
+ *
+ * Formats are vsnprintf's. A record is one line, a trailing newline is
+ * optional; longer messages are cut to fit LOG_LINE_MAX.
+ */
+
+#define LOG_EMERG   0
+#define LOG_ALERT   1
+#define LOG_CRIT    2
+#define LOG_ERR     3
+#define LOG_WARNING 4
+#define LOG_NOTICE  5
+#define LOG_INFO    6
+#define LOG_DEBUG   7
+
+#define LOG_RECORDS  256            /* a power of two */
+#define LOG_LINE_MAX 120
+
+/* Output device for log records, write() gets whole lines */
+struct console
+{
+    const char *name;
+    void (*write)(const char *s, size_t len);
+    void (*flush)(void);            /* optional, push out what write() buffered */
+    struct console *next;
+};
+
+void console_register(struct console *con);
+
+/* Records up to this level are printed, the rest are only kept */
+extern int console_loglevel;
+
+void printk(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/* Print records from a softirq from now on, needs softirqs */
+void printk_init(void);
+
+/*
+ * Take the console lock, or fail if it is held; unlocking prints the backlog.
+ * The lock also guards the terminal, anything that writes to it holds the
+ * lock. console_lock waits for it, threads only, not from interrupts.
+ */
+int console_trylock(void);
+void console_lock(void);
+void console_unlock(void);
+
+/*
+ * Raise 'softirq' the next time the console lock is let go. For a softirq
+ * that found the lock held: it may not wait, and raising itself again would
+ * only spin. Try the lock once more after this, it may have just gone.
+ */
+void console_defer(unsigned int softirq);
+
+/* Print what is logged now and flush the consoles, unless someone holds the lock */
+void console_flush(void);
+
+/* Dying: take the console whoever holds it and print everything */
+void console_flush_on_panic(void);
+
+/* Cost of a printk call, records dropped so far */
+void printk_bench(void);
+/* vsnprintf against digit-at-a-time conversion */
+void vsnprintf_bench(void);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _KERNEL_PROCESS_H
+#define _KERNEL_PROCESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/vmm.h>
+
+/* ======== Processes ======== */
+/*
+ * A process is an address space and the one thread that runs in it. The
+ * thread starts in the kernel on the new address space, where 'setup'
+ * maps the program and drops to ring 3 through enter_user(). System
+ * calls, interrupts and faults come back in on its kernel stack (the
+ * TSS's esp0). A fault the kernel cannot resolve ends the process, not
+ * the system.
+ *
+ * The user half is described by areas. A page of an area gets its frame
+ * when it is first touched: copied from the area's file bytes (a major
+ * fault) or zeroed past them (a minor fault). Both are counted and
+ * printed when the process exits.
+ *
+ * The file pages of read-only areas are shared through a vm_object: every
+ * process running the same executable maps the same text frames, and only
+ * the first to touch a page copies it. fork() shares everything else
+ * copy-on-write (see vmm.h), so the child costs its page tables up front
+ * and a page per page written afterwards.
+ */
+
+struct vm_object
+{
+    const uint8_t *file;
+    uint32_t size;
+    uint32_t *frames;           /* per page, 0 until some process reads it */
+    unsigned int refs;          /* areas using it */
+    struct vm_object *next;
+};
+
+struct vm_area
+{
+    uint32_t start, end;        /* page aligned */
+    uint32_t flags;             /* VMM_USER, and VMM_WRITE if writable */
+    const uint8_t *file;        /* contents of the first file_size bytes */
+    uint32_t file_size;
+    struct vm_object *object;   /* read-only areas with file bytes */
+    struct vm_area *next;
+};
+
+struct process
+{
+    unsigned int pid;
+    const char *name;
+    struct vmm_space *space;
+
+    struct vm_area *areas;
+    unsigned int minor_faults;
+    unsigned int major_faults;
+
+    void (*setup)(void *arg);
+    void *setup_arg;
+};
+
+/* Start a process, returns its pid or -1. 'setup' returns only on failure */
+int process_create(const char *name, void (*setup)(void *arg), void *arg);
+
+/* Copy the running process: the child returns to ring 3 through 'r'
+ * with eax 0. Returns the child's pid or -1 */
+int process_fork(struct regs *r);
+
+__attribute__((__noreturn__))
+void process_exit(int status);
+
+/* The running thread's process, 0 in a kernel thread */
+struct process *process_current();
+
+/* Add an area to 'p', returns 0, or -1 if it overlaps another or no memory */
+int process_map(struct process *p, uint32_t start, uint32_t end, uint32_t flags,
+                const void *file, uint32_t file_size);
+
+/* Called from the #PF handler, returns 1 when the fault was resolved */
+int process_page_fault(uint32_t addr, uint32_t err);
+
+/* Copy position-independent code to read-only user pages at 'virt' */
+int user_map_code(uint32_t virt, const void *code, size_t size);
+
+/* Context switch between two processes yielding from ring 3, with and
+ * without the FPU in use */
+void process_switch_bench();
+
+/* fork and exit of a child against the parent's resident size */
+void process_fork_bench();
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _KERNEL_RAMFS_H
+#define _KERNEL_RAMFS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/multiboot.h>
+
+/* ======== Initial ramdisk (initrd) ======== */
+/*
+ * iso.sh packs initrd/ into a ustar archive that GRUB loads as the first
+ * multiboot module. The PMM keeps its frames reserved; mounting maps them
+ * read-only into the kernel and indexes the archive headers. Nothing is
+ * copied: a file's name and data point straight into the module, and a
+ * read hands out a pointer, not a copy.
+ *
+ * Regular files only, under their archive path without a leading "./".
+ * kernel_main starts /init from it, built by iso.sh from user/init.S.
+ */
+
+#define TAR_BLOCK    512
+#define TAR_NAME_MAX 100
+
+/* ustar header, numbers are NUL or space terminated octal text */
+struct tar_header
+{
+    char name[TAR_NAME_MAX];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char type;
+    char linkname[100];
+    char magic[6];              /* "ustar\0" */
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+} __attribute__((packed));
+
+#define TAR_REGULAR  '0'
+#define TAR_AREGULAR '\0'       /* pre-POSIX regular file */
+
+struct ramfs_file
+{
+    const char *name;           /* in the archive, NUL terminated */
+    const uint8_t *data;
+    size_t size;
+};
+
+/* Note where the bootloader put the initrd, before pmm_init() */
+void ramfs_init(struct multiboot_info *mbi);
+
+/* Map and index the initrd, returns the number of files or -1 */
+int ramfs_mount();
+
+const struct ramfs_file *ramfs_open(const char *path);
+
+/* Point *data at up to 'size' bytes from 'offset', returns how many */
+size_t ramfs_read(const struct ramfs_file *f, size_t offset, size_t size, const void **data);
+
+/* Start an executable from the initrd, returns its pid or -1 */
+int ramfs_exec(const char *path);
+
+/* The i'th file, 0 past the last */
+const struct ramfs_file *ramfs_file(unsigned int i);
+
+/* Indexing the mounted archive again, in cycles */
+void ramfs_bench();
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef _KERNEL_RING_H
+#define _KERNEL_RING_H
+
+#include <stdint.h>
+
+/* ======== Single-producer single-consumer ring ======== */
+/*
+ * A byte queue with one writer and one reader that never take a lock:
+ * only the producer moves head and only the consumer moves tail. Both
+ * indices run freely and are masked on access, so head - tail is the fill
+ * level. The release store of an index publishes the slot it covers,
+ * which makes it safe to push from an interrupt handler while a thread
+ * pops, without disabling interrupts on either side.
+ *
+ * The storage size must be a power of two.
+ */
+
+struct spsc_ring
+{
+    uint32_t head;              /* next slot to write, producer only */
+    uint32_t tail;              /* next slot to read, consumer only */
+    uint32_t mask;
+    unsigned char *buf;
+};
+
+#define SPSC_RING_INIT(storage) { 0, 0, sizeof(storage) - 1, (storage) }
+
+/* Returns 0 when the ring is full */
+static inline int spsc_push(struct spsc_ring *r, unsigned char c)
+{
+    uint32_t head = r->head;
+
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) > r->mask)
+        return 0;
+
+    r->buf[head & r->mask] = c;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/* Returns 0 when the ring is empty */
+static inline int spsc_pop(struct spsc_ring *r, unsigned char *c)
+{
+    uint32_t tail = r->tail;
+
+    if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail)
+        return 0;
+
+    *c = r->buf[tail & r->mask];
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static inline int spsc_empty(struct spsc_ring *r)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef _KERNEL_SCHED_H
+#define _KERNEL_SCHED_H
+
+#include <stdint.h>
+#include <kernel/system.h>
+
+struct process;
+
+/* ======== Scheduler ======== */
+/*
+ * Preemptive round-robin scheduler for kernel threads.
+ *
+ * Every priority level has a FIFO ready queue and a bit in a bitmap of
+ * non-empty levels, so picking the next thread is one bit scan. Priority 0
+ * is the highest. A thread runs for SCHED_TIMESLICE timer ticks before it
+ * goes to the back of its queue. The idle thread (the boot context) is
+ * never queued and only runs when every queue is empty. The timer tick
+ * is stopped while it runs, see kernel/timer.h.
+ */
+
+#define SCHED_PRIORITIES        8
+#define SCHED_PRIORITY_DEFAULT  4
+#define SCHED_TIMESLICE         5   /* ticks */
+
+#define THREAD_STACK_ORDER      1   /* 8 KiB kernel stacks */
+
+enum thread_state
+{
+    THREAD_READY,
+    THREAD_RUNNING,
+    THREAD_BLOCKED,
+    THREAD_DEAD,
+};
+
+struct thread
+{
+    uint32_t esp;                   /* saved by switch_context */
+    void *stack;
+    unsigned int id;
+    const char *name;
+    enum thread_state state;
+    unsigned int priority;
+    unsigned int slice;             /* ticks left before preemption */
+
+    /* CPU time accounting */
+    unsigned int cpu_ticks;
+    unsigned long long cpu_cycles;
+    unsigned long long switched_in;
+
+    struct process *proc;           /* 0 for kernel threads */
+    void *fpu_state;                /* saved FPU registers, once it used them */
+
+    struct thread *next;            /* ready or wait queue */
+    struct thread *all_next;        /* every live thread */
+};
+
+struct wait_queue
+{
+    struct thread *head;
+    struct thread *tail;
+};
+
+/* lives in boot.S */
+extern void switch_context(uint32_t *old_esp, uint32_t new_esp);
+extern void thread_trampoline();
+
+void sched_init();
+
+struct thread *thread_create(const char *name, void (*entry)(void *arg), void *arg,
+                             unsigned int priority);
+__attribute__((__noreturn__))
+void thread_exit();
+struct thread *thread_current();
+int sched_idle();
+int sched_can_block();
+
+void schedule();
+void sched_yield();
+void sched_tick();
+void sched_preempt();
+
+/* Sleep on 'wq'. Interrupts must be disabled while checking the condition */
+void wait_queue_sleep(struct wait_queue *wq);
+void wait_queue_wake_one(struct wait_queue *wq);
+void wait_queue_wake_all(struct wait_queue *wq);
+
+void sched_stats();
+
+/* Cycles per switch between two threads yielding to each other */
+void sched_switch_bench();
+
+#endif
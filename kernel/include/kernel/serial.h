@@ -0,0 +1,18 @@
+#ifndef _KERNEL_SERIAL_H
+#define _KERNEL_SERIAL_H
+
+#include <stddef.h>
+
+/* ======== Serial port ======== */
+/*
+ * COM1 at 115200 baud, 8N1, written by polling. serial_init registers it
+ * as a console, so the kernel log shows up on the host (qemu -serial).
+ */
+
+#define SERIAL_COM1 0x3F8
+
+/* Returns 0 when there is no UART at COM1 */
+int serial_init(void);
+void serial_write(const char *s, size_t len);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef _KERNEL_SYSCALL_H
+#define _KERNEL_SYSCALL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+
+#include <kernel/system.h>
+
+/* ======== System calls ======== */
+/*
+ * Two ways into the same table of handlers (numbers in sys/syscall.h):
+ *
+ * int $0x80, a DPL 3 gate: eax = number, ebx, ecx, edx = arguments. It
+ * goes through the full interrupt frame like any ISR and works on every
+ * CPU.
+ *
+ * SYSENTER, when CPUID reports SEP: eax = number, ebx, esi, edi =
+ * arguments, ecx = user stack, edx = return address. The entry stub saves
+ * only those two and calls the handler straight from the table; SYSEXIT
+ * returns to ring 3 without an iret.
+ *
+ * Both return the result in eax and preserve everything else except ecx
+ * and edx on the SYSENTER path. fork() needs the whole frame and works
+ * through int $0x80 only. Handlers run with interrupts enabled on
+ * the calling thread's kernel stack.
+ */
+
+#define SYSCALL_VECTOR 0x80
+
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+typedef int (*syscall_fn)(uint32_t a, uint32_t b, uint32_t c);
+
+extern syscall_fn syscall_table[SYSCALL_MAX];
+
+/* SYSENTER is set up */
+extern int syscall_sysenter;
+
+/* lives in boot.S */
+extern void syscall_stub();
+extern void sysenter_entry();
+/* Drop to ring 3 at eip with the stack at esp */
+__attribute__((__noreturn__))
+void enter_user(uint32_t eip, uint32_t esp);
+/* Copy from user memory the caller has checked lies below
+ * KERNEL_VIRTUAL_BASE. Returns 0, or -1 if part of it is not mapped */
+int copy_from_user(void *dst, const void *src, size_t size);
+
+/* Return to ring 3 with every register from a saved int $0x80 frame */
+__attribute__((__noreturn__))
+void enter_user_frame(struct regs *r);
+
+void syscall_install();
+void syscall_handler(struct regs *r);
+
+/* Null system call round trip from ring 3, int $0x80 against SYSENTER */
+void syscall_bench();
+
+#endif
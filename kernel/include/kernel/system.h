@@ -10,10 +10,63 @@ struct regs
     unsigned int eip, cs, eflags, useresp, ss;   /* pushed by the processor automatically */ 
 };
 
+/* The kernel is linked at 3GB + 1MB, see linker.ld and boot.S */
+#define KERNEL_VIRTUAL_BASE 0xC0000000
+
+/* Read the CPU time-stamp counter (cycles since reset) */
+static inline unsigned long long rdtsc(void)
+{
+    unsigned long long ret;
+    __asm__ __volatile__ ("rdtsc" : "=A" (ret));
+    return ret;
+}
+
+/* cpuid leaf 1, edx feature bits */
+#define CPUID_FEAT_EDX_FPU (1 << 0)
+#define CPUID_FEAT_EDX_TSC (1 << 4)
+#define CPUID_FEAT_EDX_SEP (1 << 11)
+#define CPUID_FEAT_EDX_PGE (1 << 13)
+#define CPUID_FEAT_EDX_FXSR (1 << 24)
+#define CPUID_FEAT_EDX_SSE2 (1 << 26)
+
+static inline void cpuid(unsigned int leaf, unsigned int *eax, unsigned int *ebx,
+                         unsigned int *ecx, unsigned int *edx)
+{
+    __asm__ __volatile__ ("cpuid"
+                          : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+                          : "a" (leaf), "c" (0));
+}
+
+static inline void wrmsr(unsigned int msr, unsigned long long value)
+{
+    __asm__ __volatile__ ("wrmsr" : : "c" (msr), "A" (value));
+}
+
+/* Copy 'count' 32-bit words, the widest a string move goes on i386 */
+static inline void copy_dwords(void *dst, const void *src, unsigned int count)
+{
+    __asm__ __volatile__ ("rep movsl"
+                          : "+D" (dst), "+S" (src), "+c" (count)
+                          : : "memory");
+}
+
+/* Disable interrupts, returning the previous eflags for irq_restore() */
+static inline unsigned int irq_save(void)
+{
+    unsigned int flags;
+    __asm__ __volatile__ ("pushf\n\tpop %0\n\tcli" : "=r" (flags) : : "memory");
+    return flags;
+}
+
+/* Re-enable interrupts only if they were enabled before irq_save() */
+static inline void irq_restore(unsigned int flags)
+{
+    if (flags & 0x200)
+        __asm__ __volatile__ ("sti" : : : "memory");
+}
+
 unsigned char inportb (unsigned short _port);
 
 void outportb(unsigned short port, unsigned char value);
 
-char* itoa(int value, char *str, int base); // TODO move to stdlib
-
 #endif
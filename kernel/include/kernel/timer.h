@@ -0,0 +1,90 @@
+#ifndef _KERNEL_TIMER_H
+#define _KERNEL_TIMER_H
+
+#include <stdint.h>
+#include <kernel/clock.h>
+
+/* ======== Kernel timers ======== */
+/*
+ * Timers live in a hierarchical timing wheel, six levels of 64 slots. A
+ * level 0 slot spans 2^TIMER_WHEEL_SHIFT ns (~65 us), each level above
+ * spans 64 times the one below. A timer goes into the level whose range
+ * covers its deadline, and a higher slot is cascaded down once the wheel
+ * reaches it, so adding, cancelling and expiring a timer are all O(1).
+ * Deadlines are rounded up to the next level 0 slot.
+ *
+ * The clock-event device runs in one-shot mode and is programmed for the
+ * next slot with work in it, found from per-level bitmaps. Nothing fires in
+ * between, however many timers are outstanding.
+ *
+ * The scheduler tick is an ordinary timer. It re-arms itself every
+ * TICK_NS while threads compete for the CPU and stops when the idle thread
+ * has nothing to preempt (tickless idle).
+ *
+ * Timer callbacks run in interrupt context with interrupts disabled.
+ */
+
+#define TIMER_WHEEL_SHIFT  16       /* ns per level 0 slot, as a power of two */
+#define TIMER_WHEEL_BITS   6
+#define TIMER_WHEEL_SIZE   (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 6
+
+#define TIMER_HZ 100                        /* scheduler tick rate */
+#define TICK_NS  (1000000000ull / TIMER_HZ)
+
+/* A device that can raise one interrupt after a given delay */
+struct clock_event
+{
+    const char *name;
+    uint64_t min_delta_ns;
+    uint64_t max_delta_ns;
+    void (*set_next_event)(uint64_t delta_ns);
+};
+
+struct timer
+{
+    uint64_t expires;               /* clock_monotonic_ns() deadline */
+    void (*fn)(void *arg);
+    void *arg;
+    struct timer *next;
+    struct timer **pprev;           /* 0 unless pending */
+};
+
+static inline void timer_setup(struct timer *t, void (*fn)(void *arg), void *arg)
+{
+    t->fn = fn;
+    t->arg = arg;
+    t->next = 0;
+    t->pprev = 0;
+}
+
+static inline int timer_pending(const struct timer *t)
+{
+    return t->pprev != 0;
+}
+
+/* Scheduler ticks since boot, they stop while the system idles */
+extern uint64_t timer_ticks;
+
+void timer_init(struct clock_event *dev);
+void timer_interrupt();
+
+/* timer_mod and timer_cancel return whether the timer was pending */
+void timer_add(struct timer *t, uint64_t expires);
+int timer_mod(struct timer *t, uint64_t expires);
+int timer_cancel(struct timer *t);
+
+/* Called by the scheduler when a thread leaves idle */
+void timer_tick_resume();
+
+/* Block the calling thread (or halt, for the idle thread) for a while */
+void timer_sleep_ns(uint64_t ns);
+void timer_usleep(unsigned int us);
+void timer_wait(int ticks);
+
+/* Timer interrupts per second while idle, with and without the tick */
+void timer_idle_bench();
+/* Arm and cancel 100k timers, report their cost and the per-tick cost */
+void timer_wheel_bench();
+
+#endif
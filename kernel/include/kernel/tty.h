@@ -2,6 +2,7 @@
 #define _KERNEL_TTY_H
 
 #include <stddef.h>
+#include <kernel/multiboot.h>
 
 void terminal_initialize(void);
 void terminal_putchar(char c);
@@ -9,6 +10,21 @@ void terminal_write(const char* data, size_t size);
 void terminal_writestring(const char* data);
 void terminal_clear();
 
+/* Copy pending changes to the screen now, e.g. before halting */
+void terminal_flush(void);
+/* Batch screen updates on a timer from now on */
+void terminal_flush_timer_init(void);
+
+/* Switch to a heap-backed scrollback ring, once kmalloc works */
+void terminal_scrollback_init(void);
+/* Draw on the bootloader's framebuffer instead of VGA text memory */
+void terminal_framebuffer_init(struct multiboot_info *mbi);
+void terminal_scroll_view(int rows);
+void terminal_page_up(void);
+void terminal_page_down(void);
+void terminal_scroll_bench(void);
+void terminal_write_bench(void);
+
 void splash_screen();
 void terminal_prompt();
 
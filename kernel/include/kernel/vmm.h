@@ -0,0 +1,146 @@
+#ifndef _KERNEL_VMM_H
+#define _KERNEL_VMM_H
+
+#include <stdint.h>
+#include <kernel/system.h>
+
+/* ======== Virtual Memory Manager (VMM) ======== */
+/*
+ *          Page Table Entry
+ * ----------------------------------
+ * |31          12  11 9  8  ... 2 1 0|
+ * ----------------------------------
+ * |Frame address   Avail G     U W P|
+ * ----------------------------------
+ *
+ * The last page directory entry points at the directory itself, so every
+ * page table of the current address space shows up at VMM_PAGE_TABLES and
+ * the directory at VMM_PAGE_DIRECTORY. Page tables are never mapped by hand.
+ *
+ * A page marked VMM_LAZY is reserved but has no frame yet. The page fault
+ * handler backs it with a zeroed frame on first touch.
+ *
+ * Every process has an address space of its own: a page directory whose
+ * user half (below KERNEL_VIRTUAL_BASE) is private and whose kernel half
+ * is a copy of the boot directory's. The boot directory stays the master
+ * for the kernel half. A new kernel page table goes into the master too
+ * and bumps a generation count, and a directory catches up with the
+ * master when it is switched to. Kernel threads run on the boot directory.
+ *
+ * A forked space shares every user frame with its parent. Writable pages
+ * lose VMM_WRITE and are marked VMM_COW in both, and the first write to
+ * one copies it unless nobody else maps the frame any more. boot.S turns
+ * on CR0.WP with paging, so the kernel's own writes fault the same way.
+ */
+
+#define VMM_PRESENT 0x001
+#define VMM_WRITE   0x002
+#define VMM_USER    0x004
+#define VMM_GLOBAL  0x100   /* kept in the TLB across cr3 reloads (PGE) */
+#define VMM_LAZY    0x200   /* available bit: allocate on first touch */
+#define VMM_COW     0x400   /* available bit: shared, copy on first write */
+
+#define CR4_PGE 0x080
+
+/* page fault error code */
+#define VMM_FAULT_PRESENT 0x1
+#define VMM_FAULT_WRITE   0x2
+#define VMM_FAULT_USER    0x4
+
+#define VMM_PAGE_TABLES    ((uint32_t *) 0xFFC00000)
+#define VMM_PAGE_DIRECTORY ((uint32_t *) 0xFFFFF000)
+
+/* Directory entries of the kernel half, the last one is the recursive entry */
+#define VMM_KERNEL_PDE (KERNEL_VIRTUAL_BASE >> 22)
+#define VMM_SELF_PDE   1023
+
+/* Kernel heap, pages are handed out by kpage_alloc() */
+#define KHEAP_START 0xD0000000
+#define KHEAP_END   0xF0000000
+
+/* Device memory such as the framebuffer, mapped by vmm_map_mmio(), and
+ * multiboot modules, mapped by vmm_map_boot() */
+#define KMMIO_START 0xF0000000
+#define KMMIO_END   0xFFC00000
+
+static inline void invlpg(uint32_t virt)
+{
+    __asm__ __volatile__ ("invlpg (%0)" : : "r" (virt) : "memory");
+}
+
+static inline uint32_t read_cr0(void)
+{
+    uint32_t ret;
+    __asm__ __volatile__ ("mov %%cr0, %0" : "=r" (ret));
+    return ret;
+}
+
+static inline void write_cr0(uint32_t value)
+{
+    __asm__ __volatile__ ("mov %0, %%cr0" : : "r" (value) : "memory");
+}
+
+static inline uint32_t read_cr2(void)
+{
+    uint32_t ret;
+    __asm__ __volatile__ ("mov %%cr2, %0" : "=r" (ret));
+    return ret;
+}
+
+static inline uint32_t read_cr3(void)
+{
+    uint32_t ret;
+    __asm__ __volatile__ ("mov %%cr3, %0" : "=r" (ret));
+    return ret;
+}
+
+static inline void write_cr3(uint32_t value)
+{
+    __asm__ __volatile__ ("mov %0, %%cr3" : : "r" (value) : "memory");
+}
+
+static inline uint32_t read_cr4(void)
+{
+    uint32_t ret;
+    __asm__ __volatile__ ("mov %%cr4, %0" : "=r" (ret));
+    return ret;
+}
+
+static inline void write_cr4(uint32_t value)
+{
+    __asm__ __volatile__ ("mov %0, %%cr4" : : "r" (value) : "memory");
+}
+
+void vmm_init();
+void vmm_tlb_bench();
+
+int vmm_map(uint32_t virt, uint32_t phys, uint32_t flags);
+uint32_t vmm_unmap(uint32_t virt);
+int vmm_protect(uint32_t virt, uint32_t flags);
+int vmm_reserve(uint32_t virt, uint32_t flags);
+uint32_t vmm_translate(uint32_t virt);
+void *vmm_map_mmio(uint32_t phys, uint32_t size);
+const void *vmm_map_boot(uint32_t phys, uint32_t size);
+
+int vmm_page_fault(uint32_t addr, uint32_t err);
+/* Write fault on a VMM_COW page of the current space, returns 1 when resolved */
+int vmm_copy_on_write(uint32_t addr);
+
+struct vmm_space
+{
+    uint32_t *directory;            /* in the kernel heap */
+    uint32_t phys;                  /* what goes in cr3 */
+    unsigned int kernel_gen;        /* master generation the kernel half is from */
+};
+
+/* A new address space with an empty user half */
+struct vmm_space *vmm_space_create();
+/* A copy of the current space's user half, sharing its frames copy-on-write */
+struct vmm_space *vmm_space_fork();
+/* Free an address space and drop every user page in it. If it is the
+ * current one, the kernel's is loaded instead */
+void vmm_space_destroy(struct vmm_space *space);
+/* Load an address space, 0 for the kernel's. Interrupts off */
+void vmm_switch(struct vmm_space *space);
+
+#endif
@@ -0,0 +1,131 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <kernel/bench.h>
+#include <kernel/pmm.h>
+#include <kernel/vmm.h>
+#include <kernel/irq.h>
+#include <kernel/sched.h>
+#include <kernel/syscall.h>
+#include <kernel/process.h>
+#include <kernel/elf.h>
+#include <kernel/ramfs.h>
+#include <kernel/timer.h>
+#include <kernel/tty.h>
+#include <kernel/fbcon.h>
+#include <kernel/fpu.h>
+#include <kernel/printk.h>
+#include <kernel/system.h>
+
+#define BENCH_FILTER_MAX 64
+
+struct bench
+{
+    const char *name;
+    void (*run)(void);
+};
+
+/* In the order they run; irq last, it reports what the others caused */
+static const struct bench suite[] = {
+    { "pmm",          pmm_selftest },
+    { "vmm_tlb",      vmm_tlb_bench },
+    { "timer_idle",   timer_idle_bench },
+    { "timer_wheel",  timer_wheel_bench },
+    { "sched_switch", sched_switch_bench },
+    { "syscall",      syscall_bench },
+    { "process",      process_switch_bench },
+    { "elf",          elf_bench },
+    { "fork",         process_fork_bench },
+    { "ramfs",        ramfs_bench },
+    { "irq_roundtrip", irq_roundtrip_bench },
+    { "tty_scroll",   terminal_scroll_bench },
+    { "tty_write",    terminal_write_bench },
+    { "fbcon_blit",   fbcon_blit_bench },
+    { "printk",       printk_bench },
+    { "vsnprintf",    vsnprintf_bench },
+    { "memcpy",       memcpy_bench },
+    { "irq_stats",    irq_stats },
+};
+
+static int bench_enabled = 0;
+static char bench_filter[BENCH_FILTER_MAX];  /* comma separated prefixes, empty for all */
+
+void bench_init(struct multiboot_info *mbi)
+{
+    if (!(mbi->flags & MULTIBOOT_INFO_CMDLINE) || mbi->cmdline >= PMM_BOOT_WINDOW - BENCH_FILTER_MAX)
+        return;
+
+    /* the first word is the kernel's path */
+    for (const char *p = phys_to_virt(mbi->cmdline); *p; )
+    {
+        size_t len = 0;
+        while (p[len] && p[len] != ' ')
+            len++;
+
+        if (len == 5 && !strncmp(p, "bench", 5))
+            bench_enabled = 1;
+        else if (len > 6 && len - 6 < BENCH_FILTER_MAX && !strncmp(p, "bench=", 6))
+        {
+            bench_enabled = 1;
+            memcpy(bench_filter, p + 6, len - 6);
+            bench_filter[len - 6] = 0;
+        }
+
+        p += len;
+        while (*p == ' ')
+            p++;
+    }
+}
+
+int bench_mode(void)
+{
+    return bench_enabled;
+}
+
+void bench_report(const char *name, uint64_t value, const char *unit)
+{
+    if (bench_enabled)
+        printk(LOG_NOTICE, "BENCH %s %llu %s\n", name, value, unit);
+}
+
+static int bench_selected(const char *name)
+{
+    const char *p = bench_filter;
+
+    if (!*p)
+        return 1;
+    while (*p)
+    {
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t) (end - p) : strlen(p);
+
+        if (len && !strncmp(name, p, len))
+            return 1;
+        p += end ? len + 1 : len;
+    }
+    return 0;
+}
+
+void bench_run(void)
+{
+    unsigned int ran = 0;
+
+    printk(LOG_NOTICE, "BENCH-BEGIN\n");
+    for (size_t i = 0; i < sizeof(suite) / sizeof(suite[0]); i++)
+    {
+        if (!bench_selected(suite[i].name))
+            continue;
+        printk(LOG_INFO, "bench: %s\n", suite[i].name);
+        suite[i].run();
+        ran++;
+    }
+    printk(LOG_NOTICE, "BENCH-END %u\n", ran);
+
+    console_flush();
+    qemu_exit(0);
+}
+
+void qemu_exit(unsigned int code)
+{
+    outportb(QEMU_EXIT_PORT, code);
+}
@@ -1,4 +1,6 @@
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <security.h>
 
@@ -10,26 +12,76 @@
 #include <kernel/irq.h>
 #include <kernel/pit.h>
 #include <kernel/keyboard.h>
+#include <kernel/multiboot.h>
+#include <kernel/pmm.h>
+#include <kernel/vmm.h>
+#include <kernel/sched.h>
+#include <kernel/timer.h>
+#include <kernel/clock.h>
+#include <kernel/fbcon.h>
+#include <kernel/printk.h>
+#include <kernel/serial.h>
+#include <kernel/fpu.h>
+#include <kernel/syscall.h>
+#include <kernel/bench.h>
+#include <kernel/ramfs.h>
 
-void kernel_main(void) {
+void kernel_main(uint32_t magic, uint32_t mbi_addr) {
     gdt_install();
     terminal_initialize();
+    serial_init();
     idt_install();
     isrs_install();
     irq_install();
+    fpu_init();
+    syscall_install();
+
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC)
+        panic("not booted by a multiboot bootloader");
+
+    // boot.S identity maps the first 4 MiB into the higher half
+    struct multiboot_info *mbi = phys_to_virt(mbi_addr);
+    bench_init(mbi);
+    ramfs_init(mbi);
+    pmm_init(mbi);
+    vmm_init();
+
+    // the boot context becomes the idle thread
+    sched_init();
+    softirq_init();
+    printk_init();
+    terminal_scrollback_init();
+    terminal_framebuffer_init(mbi);
     
     keyboard_install(); 
 
     // allow for IRQs 
     __asm__ __volatile__ ("sti"); 
     
+    // measure the TSC before the timers start reading the clock
+    clock_init();
+
     //install system timer
     timer_install();
+    terminal_flush_timer_init();
+
+    // the initrd, timed against the clock
+    ramfs_mount();
     
     // TODO we need to disable printing at this stage.
     // only accept different boot options
     splash_screen();
 
+    // "bench" on the command line: run the benchmarks and power off
+    if (bench_mode())
+        bench_run();
+
+    pmm_selftest();
+
+    // the first program, runs to its end or first block before the prompt
+    if (ramfs_exec("/init") < 0)
+        printk(LOG_WARNING, "no /init in the initrd\n");
+
     // prompt
     char *usr = "root";
     char *device_name = "chimpos-dev";
@@ -37,9 +89,10 @@ void kernel_main(void) {
     terminal_prompt(usr, device_name, curr_dir);
 
 
-    //event loop - FIXME as of right now, monotasking system
-    while (1) {
-
+    // idle thread: sleep until the next interrupt, the interrupt that makes
+    // another thread ready preempts us (the tick is off while we idle)
+    for (;;) {
+        __asm__ __volatile__ ("hlt");
     }
 
     //asm volatile ("1: jmp 1b"); // pseudo breakpoint
@@ -0,0 +1,333 @@
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <kernel/printk.h>
+#include <kernel/bench.h>
+#include <kernel/clock.h>
+#include <kernel/irq.h>
+#include <kernel/sched.h>
+#include <kernel/system.h>
+
+/* seconds are right-aligned in 5 digits: "[    1.234567] " */
+#define LOG_PREFIX_MAX 24
+
+struct log_record
+{
+    uint32_t seq;                   /* sequence number + 1 once written, 0 while being written */
+    uint8_t level;
+    uint8_t len;
+    uint64_t time_ns;
+    char text[LOG_LINE_MAX];
+};
+
+static struct log_record log_buf[LOG_RECORDS];
+static uint32_t log_head = 0;       /* next sequence number to hand out */
+static uint32_t log_tail = 0;       /* next one to print, console lock holder only */
+static uint32_t log_dropped = 0;
+
+static struct console *consoles = 0;
+static int console_locked = 0;
+static uint32_t console_deferred = 0;  /* softirqs to raise when the lock goes */
+static int printk_async = 0;
+
+int console_loglevel = LOG_INFO;
+
+void console_register(struct console *con)
+{
+    unsigned int flags = irq_save();
+    con->next = consoles;
+    consoles = con;
+    irq_restore(flags);
+}
+
+/* Into the record, cut to fit, without the newline records imply */
+static size_t log_format(char *buf, const char *fmt, va_list ap)
+{
+    int len = vsnprintf(buf, LOG_LINE_MAX, fmt, ap);
+
+    if (len < 0)
+        len = 0;
+    if (len > LOG_LINE_MAX - 1)
+        len = LOG_LINE_MAX - 1;
+    if (len && buf[len - 1] == '\n')
+        len--;
+    return len;
+}
+
+void printk(int level, const char *fmt, ...)
+{
+    uint64_t now = clock_monotonic_ns();
+    uint32_t seq = __atomic_fetch_add(&log_head, 1, __ATOMIC_RELAXED);
+    struct log_record *r = &log_buf[seq & (LOG_RECORDS - 1)];
+
+    /* a console still copying the record we overwrite sees it change */
+    __atomic_store_n(&r->seq, 0, __ATOMIC_SEQ_CST);
+
+    va_list ap;
+    va_start(ap, fmt);
+    r->len = log_format(r->text, fmt, ap);
+    va_end(ap);
+    r->level = level;
+    r->time_ns = now;
+    __atomic_store_n(&r->seq, seq + 1, __ATOMIC_RELEASE);
+
+    if (printk_async)
+        softirq_raise(SOFTIRQ_PRINTK);
+    else if (console_trylock())
+        console_unlock();
+}
+
+/* ======== Consoles ======== */
+
+/* 'value' in decimal, right-aligned in at least 'width' characters */
+static size_t put_decimal(char *buf, uint32_t value, int width, char pad)
+{
+    char digits[10];
+    int n = 0;
+    size_t len = 0;
+
+    do
+    {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    while (width-- > n)
+        buf[len++] = pad;
+    while (n)
+        buf[len++] = digits[--n];
+    return len;
+}
+
+static size_t log_prefix(char *buf, uint64_t ns)
+{
+    uint32_t sec = ns / 1000000000;
+    uint32_t usec = (uint32_t) (ns - sec * 1000000000ull) / 1000;
+    size_t len = 0;
+
+    buf[len++] = '[';
+    len += put_decimal(buf + len, sec, 5, ' ');
+    buf[len++] = '.';
+    len += put_decimal(buf + len, usec, 6, '0');
+    buf[len++] = ']';
+    buf[len++] = ' ';
+    return len;
+}
+
+/*
+ * Where a record's seq stands against the one we want next: 0 for that
+ * record, finished; below 0 while its slot still holds an older lap (or 0,
+ * mid-write), as its writer has a number but has not started; above 0 once
+ * a writer that went round the ring overwrote it.
+ */
+static int32_t log_lap(uint32_t seq, uint32_t want)
+{
+    return seq ? (int32_t) (seq - 1 - want) : -1;
+}
+
+/* A finished record is waiting, or one that was overwritten */
+static int log_ready(void)
+{
+    uint32_t tail = __atomic_load_n(&log_tail, __ATOMIC_RELAXED);
+
+    return __atomic_load_n(&log_head, __ATOMIC_ACQUIRE) != tail
+        && log_lap(__atomic_load_n(&log_buf[tail & (LOG_RECORDS - 1)].seq, __ATOMIC_ACQUIRE), tail) >= 0;
+}
+
+/* Print records until the next one is unfinished. Console lock held */
+static void log_drain(void)
+{
+    char line[LOG_PREFIX_MAX + LOG_LINE_MAX + 1];
+
+    for (;;)
+    {
+        uint32_t head = __atomic_load_n(&log_head, __ATOMIC_ACQUIRE);
+        if (log_tail == head)
+            return;
+
+        /* writers went round the ring, what we had not printed is gone */
+        if (head - log_tail > LOG_RECORDS)
+        {
+            log_dropped += head - LOG_RECORDS - log_tail;
+            log_tail = head - LOG_RECORDS;
+        }
+
+        struct log_record *r = &log_buf[log_tail & (LOG_RECORDS - 1)];
+        uint32_t seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+
+        /* its writer was interrupted, and prints it once it is done */
+        if (log_lap(seq, log_tail) < 0)
+            return;
+
+        if (log_lap(seq, log_tail) == 0)
+        {
+            size_t len = log_prefix(line, r->time_ns);
+            int level = r->level;
+            memcpy(line + len, r->text, r->len);
+            len += r->len;
+            line[len++] = '\n';
+
+            /* a writer that lapped us changed the record while we copied it */
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) == seq)
+            {
+                log_tail++;
+                if (level <= console_loglevel)
+                    for (struct console *con = consoles; con; con = con->next)
+                        con->write(line, len);
+                continue;
+            }
+        }
+
+        /* a writer lapped us: the record we wanted is gone */
+        log_dropped++;
+        log_tail++;
+    }
+}
+
+int console_trylock(void)
+{
+    return !__atomic_exchange_n(&console_locked, 1, __ATOMIC_ACQUIRE);
+}
+
+/* Threads wait by yielding to the holder, which is never a context they interrupted */
+void console_lock(void)
+{
+    while (!console_trylock())
+    {
+        if (thread_current())
+            sched_yield();
+        else
+            __asm__ __volatile__ ("pause");
+    }
+}
+
+void console_unlock(void)
+{
+    do
+    {
+        log_drain();
+        __atomic_store_n(&console_locked, 0, __ATOMIC_RELEASE);
+
+        /* a record finished after we looked, its writer found us holding the lock */
+    } while (log_ready() && console_trylock());
+
+    uint32_t deferred = __atomic_exchange_n(&console_deferred, 0, __ATOMIC_SEQ_CST);
+    for (unsigned int nr = 0; deferred; nr++, deferred >>= 1)
+        if (deferred & 1)
+            softirq_raise(nr);
+}
+
+void console_defer(unsigned int softirq)
+{
+    __atomic_fetch_or(&console_deferred, 1u << softirq, __ATOMIC_SEQ_CST);
+}
+
+void console_flush(void)
+{
+    if (console_trylock())
+        console_unlock();
+    for (struct console *con = consoles; con; con = con->next)
+        if (con->flush)
+            con->flush();
+}
+
+void console_flush_on_panic(void)
+{
+    __atomic_store_n(&console_locked, 1, __ATOMIC_SEQ_CST);
+    log_drain();
+    for (struct console *con = consoles; con; con = con->next)
+        if (con->flush)
+            con->flush();
+}
+
+static void printk_softirq()
+{
+    if (console_trylock())
+        console_unlock();
+}
+
+void printk_init(void)
+{
+    softirq_register(SOFTIRQ_PRINTK, "printk", printk_softirq);
+    printk_async = 1;
+}
+
+/* ======== Benchmark ======== */
+
+#define PRINTK_BENCH_MESSAGES (LOG_RECORDS / 2)
+
+/* Below console_loglevel nothing is printed, this is the cost of logging */
+void printk_bench(void)
+{
+    unsigned long long start = rdtsc();
+    for (int i = 0; i < PRINTK_BENCH_MESSAGES; i++)
+        printk(LOG_DEBUG, "printk: bench message %s", "0123456789");
+    unsigned int cost = (rdtsc() - start) / PRINTK_BENCH_MESSAGES;
+
+    printk(LOG_INFO, "printk: %u cycles per message, %u dropped since boot\n", cost, log_dropped);
+    bench_report("printk", cost, "cycles");
+}
+
+#define FORMAT_BENCH_ROUNDS 10000
+
+/* digit at a time with a real division each, as itoa used to */
+static char *naive_u64(uint64_t value, char *end)
+{
+    *--end = 0;
+    do
+    {
+        *--end = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    return end;
+}
+
+/*
+ * Formatted output rates of vsnprintf: 32-bit and 64-bit decimal against
+ * a division per digit, then a whole log line, in cycles per call.
+ */
+void vsnprintf_bench(void)
+{
+    char buf[LOG_LINE_MAX];
+    unsigned int cost[5];
+    uint64_t big = 18446744073709ull;
+    volatile uint32_t sink = 0;
+
+    unsigned long long start = rdtsc();
+    for (uint32_t i = 0; i < FORMAT_BENCH_ROUNDS; i++)
+        sink += *naive_u64(i * 429497u, buf + sizeof(buf));
+    cost[0] = (rdtsc() - start) / FORMAT_BENCH_ROUNDS;
+
+    start = rdtsc();
+    for (uint32_t i = 0; i < FORMAT_BENCH_ROUNDS; i++)
+        sink += snprintf(buf, sizeof(buf), "%u", i * 429497u);
+    cost[1] = (rdtsc() - start) / FORMAT_BENCH_ROUNDS;
+
+    start = rdtsc();
+    for (uint32_t i = 0; i < FORMAT_BENCH_ROUNDS; i++)
+        sink += *naive_u64(big * i, buf + sizeof(buf));
+    cost[2] = (rdtsc() - start) / FORMAT_BENCH_ROUNDS;
+
+    start = rdtsc();
+    for (uint32_t i = 0; i < FORMAT_BENCH_ROUNDS; i++)
+        sink += snprintf(buf, sizeof(buf), "%llu", big * i);
+    cost[3] = (rdtsc() - start) / FORMAT_BENCH_ROUNDS;
+
+    start = rdtsc();
+    for (uint32_t i = 0; i < FORMAT_BENCH_ROUNDS; i++)
+        sink += snprintf(buf, sizeof(buf), "irq %d: %u interrupts, %llu cycles each, %#010x %-8s|",
+                         i & 15, i * 7u, big * i, i, "timer");
+    cost[4] = (rdtsc() - start) / FORMAT_BENCH_ROUNDS;
+    (void) sink;
+
+    printk(LOG_INFO, "vsnprintf: cycles per 32-bit number %u (digit loop %u), 64-bit %u (digit loop %u)\n",
+           cost[1], cost[0], cost[3], cost[2]);
+    printk(LOG_INFO, "vsnprintf: %u cycles per log line, %llu lines/s\n",
+           cost[4], cost[4] ? clock_tsc_khz() * 1000ull / cost[4] : 0);
+    bench_report("vsnprintf_u32", cost[1], "cycles");
+    bench_report("vsnprintf_u64", cost[3], "cycles");
+    bench_report("vsnprintf_line", cost[4], "cycles");
+}
@@ -0,0 +1,221 @@
+#include <stdint.h>
+#include <string.h>
+#include <slab.h>
+
+#include <kernel/ramfs.h>
+#include <kernel/elf.h>
+#include <kernel/pmm.h>
+#include <kernel/vmm.h>
+#include <kernel/clock.h>
+#include <kernel/system.h>
+#include <kernel/printk.h>
+#include <kernel/bench.h>
+
+/* The first multiboot module, 0 size if there was none */
+static uint32_t initrd_phys = 0;
+static uint32_t initrd_size = 0;
+
+static const uint8_t *initrd = 0;
+static struct ramfs_file *files = 0;
+static unsigned int file_count = 0;
+
+void ramfs_init(struct multiboot_info *mbi)
+{
+    if (!(mbi->flags & MULTIBOOT_INFO_MODS) || !mbi->mods_count ||
+        mbi->mods_addr >= PMM_BOOT_WINDOW - sizeof(struct multiboot_mod_list))
+        return;
+
+    struct multiboot_mod_list *mod = phys_to_virt(mbi->mods_addr);
+    if (mod->mod_end > mod->mod_start)
+    {
+        initrd_phys = mod->mod_start;
+        initrd_size = mod->mod_end - mod->mod_start;
+    }
+}
+
+/* ======== ustar ======== */
+
+/* Octal text of up to 'len' characters, returns 0 or -1 if it is not one */
+static int tar_number(const char *s, size_t len, uint32_t *value)
+{
+    size_t i = 0;
+
+    *value = 0;
+    while (i < len && s[i] == ' ')
+        i++;
+    for (; i < len && s[i] >= '0' && s[i] <= '7'; i++)
+    {
+        if (*value >> 29)
+            return -1;
+        *value = (*value << 3) | (s[i] - '0');
+    }
+    return i == len || s[i] == ' ' || s[i] == 0 ? 0 : -1;
+}
+
+/* Sum of the header's bytes, the checksum field counted as spaces */
+static int tar_checksum_ok(const struct tar_header *h)
+{
+    const uint8_t *p = (const uint8_t *) h;
+    uint32_t sum = 0, want;
+
+    for (size_t i = 0; i < TAR_BLOCK; i++)
+        sum += p[i];
+    for (size_t i = 0; i < sizeof(h->checksum); i++)
+        sum += ' ' - (uint8_t) h->checksum[i];
+
+    return !tar_number(h->checksum, sizeof(h->checksum), &want) && sum == want;
+}
+
+/*
+ * Walk the archive, filling 'out' if given. Returns the number of regular
+ * files, or -1 if the archive is damaged. Names that need the ustar prefix
+ * field are not contiguous in the archive and are left out.
+ */
+static int ramfs_index(struct ramfs_file *out)
+{
+    uint32_t offset = 0;
+    int count = 0;
+
+    while (initrd_size >= TAR_BLOCK && offset <= initrd_size - TAR_BLOCK)
+    {
+        const struct tar_header *h = (const struct tar_header *) (initrd + offset);
+        uint32_t size;
+
+        /* the archive ends with zero blocks */
+        if (!h->name[0])
+            break;
+        if (memcmp(h->magic, "ustar", 5) || !tar_checksum_ok(h) ||
+            tar_number(h->size, sizeof(h->size), &size))
+            return -1;
+
+        uint32_t data = offset + TAR_BLOCK;
+        if (size > initrd_size - data)
+            return -1;
+
+        if ((h->type == TAR_REGULAR || h->type == TAR_AREGULAR) && !h->prefix[0] &&
+            memchr(h->name, 0, sizeof(h->name)))
+        {
+            if (out)
+            {
+                const char *name = h->name;
+                while (name[0] == '.' && name[1] == '/')
+                    name += 2;
+                while (name[0] == '/')
+                    name++;
+
+                out[count].name = name;
+                out[count].data = initrd + data;
+                out[count].size = size;
+            }
+            count++;
+        }
+
+        offset = data + ((size + TAR_BLOCK - 1) & ~(TAR_BLOCK - 1));
+    }
+    return count;
+}
+
+/* ======== Files ======== */
+
+int ramfs_mount()
+{
+    if (!initrd_size)
+        return -1;
+
+    unsigned long long start = rdtsc();
+
+    initrd = vmm_map_boot(initrd_phys, initrd_size);
+    if (!initrd)
+    {
+        printk(LOG_ERR, "ramfs: no room to map the initrd\n");
+        return -1;
+    }
+
+    int count = ramfs_index(0);
+    if (count < 0)
+    {
+        printk(LOG_ERR, "ramfs: the initrd is not a ustar archive\n");
+        initrd = 0;
+        return -1;
+    }
+    if (count)
+    {
+        files = kmalloc(count * sizeof(*files));
+        if (!files)
+        {
+            printk(LOG_ERR, "ramfs: no memory to index the initrd\n");
+            initrd = 0;
+            return -1;
+        }
+        ramfs_index(files);
+    }
+    file_count = count;
+
+    uint64_t ns = clock_cycles_to_ns(rdtsc() - start);
+    printk(LOG_INFO, "ramfs: %u files in a %u KiB initrd, mounted in %llu us\n",
+           file_count, initrd_size / 1024, ns / 1000);
+    bench_report("ramfs_mount", ns, "ns");
+    return count;
+}
+
+int ramfs_exec(const char *path)
+{
+    const struct ramfs_file *f = ramfs_open(path);
+    const void *image = 0;
+
+    if (!f || !f->size || ramfs_read(f, 0, f->size, &image) != f->size)
+        return -1;
+
+    /* the module stays mapped for good: a page faulted in is copied from it */
+    printk(LOG_INFO, "ramfs: starting %s, %llu us after the clock started\n",
+           f->name, clock_monotonic_ns() / 1000);
+    return elf_exec(f->name, image, f->size);
+}
+
+const struct ramfs_file *ramfs_open(const char *path)
+{
+    while (path[0] == '/')
+        path++;
+    for (unsigned int i = 0; i < file_count; i++)
+        if (!strncmp(files[i].name, path, TAR_NAME_MAX))
+            return &files[i];
+    return 0;
+}
+
+size_t ramfs_read(const struct ramfs_file *f, size_t offset, size_t size, const void **data)
+{
+    if (offset >= f->size)
+        return 0;
+    if (size > f->size - offset)
+        size = f->size - offset;
+
+    *data = f->data + offset;
+    return size;
+}
+
+const struct ramfs_file *ramfs_file(unsigned int i)
+{
+    return i < file_count ? &files[i] : 0;
+}
+
+/* ======== Benchmark ======== */
+
+#define RAMFS_BENCH_ROUNDS 100
+
+/* The header walk a mount does, without the mapping */
+void ramfs_bench()
+{
+    if (!file_count)
+    {
+        printk(LOG_NOTICE, "ramfs: no initrd, bench skipped\n");
+        return;
+    }
+
+    unsigned long long start = rdtsc();
+    for (int i = 0; i < RAMFS_BENCH_ROUNDS; i++)
+        ramfs_index(files);
+    unsigned int cost = (rdtsc() - start) / RAMFS_BENCH_ROUNDS;
+
+    printk(LOG_INFO, "ramfs: %u cycles to index %u files\n", cost, file_count);
+    bench_report("ramfs_index", cost, "cycles");
+}
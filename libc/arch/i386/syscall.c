@@ -0,0 +1,48 @@
+#include <sys/syscall.h>
+
+/* cpuid leaf 1, edx */
+#define CPUID_FEAT_EDX_SEP (1 << 11)
+
+/* 1 when the kernel takes SYSENTER, found out on the first call */
+static int sysenter = -1;
+
+/* The same test the kernel makes before it sets SYSENTER up */
+static int sysenter_supported(void) {
+	unsigned int eax, ebx, ecx, edx;
+
+	__asm__ ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1), "c" (0));
+
+	/* early Pentium Pros report SEP without having it */
+	unsigned int family = (eax >> 8) & 0xF, model = (eax >> 4) & 0xF, stepping = eax & 0xF;
+	if (family == 6 && model < 3 && stepping < 3)
+		return 0;
+	return (edx & CPUID_FEAT_EDX_SEP) != 0;
+}
+
+/*
+ * int $0x80 takes the arguments in ebx, ecx and edx. SYSENTER saves
+ * nothing, so ecx and edx carry the stack and the return address back to
+ * ring 3 instead and the arguments move to ebx, esi and edi. fork needs
+ * the full frame only int $0x80 saves.
+ */
+long syscall(long number, long a, long b, long c) {
+	long ret;
+
+	if (sysenter < 0)
+		sysenter = sysenter_supported();
+
+	if (sysenter && number != SYS_fork)
+		__asm__ __volatile__ ("movl %%esp, %%ecx\n\t"
+				      "movl $1f, %%edx\n\t"
+				      "sysenter\n"
+				      "1:"
+				      : "=a" (ret)
+				      : "a" (number), "b" (a), "S" (b), "D" (c)
+				      : "ecx", "edx", "memory");
+	else
+		__asm__ __volatile__ ("int $0x80"
+				      : "=a" (ret)
+				      : "a" (number), "b" (a), "c" (b), "d" (c)
+				      : "memory");
+	return ret;
+}
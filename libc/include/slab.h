@@ -0,0 +1,82 @@
+#ifndef _SLAB_H
+#define _SLAB_H 1
+
+#include <sys/cdefs.h>
+
+#include <stddef.h>
+
+/*
+ * Slab allocator (libk)
+ *
+ * Objects of one size live in slabs of SLAB_SIZE bytes, aligned to
+ * SLAB_SIZE, with the slab header at the start. The owning slab of any
+ * object is found by masking its address, so kfree never searches.
+ * Free objects are chained through a separate index array in the header,
+ * object memory is never written by the allocator and a constructed object
+ * stays constructed across free and the next alloc.
+ */
+
+#define SLAB_ORDER 2
+#define SLAB_SIZE (4096 << SLAB_ORDER)
+
+/* kmalloc size classes are 16, 32, ... 4096 bytes */
+#define KMALLOC_MIN_SHIFT 4
+#define KMALLOC_MAX_SHIFT 12
+#define KMALLOC_MAX_SIZE (1 << KMALLOC_MAX_SHIFT)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct kmem_slab;
+
+struct kmem_cache
+{
+    const char *name;
+    size_t size;                /* object size, rounded up to align */
+    size_t align;
+    size_t offset;              /* first object, from the slab start */
+    unsigned int per_slab;      /* objects per slab */
+    void (*ctor)(void *obj);
+
+    struct kmem_slab *partial;
+    struct kmem_slab *full;
+    struct kmem_slab *empty;
+
+    /* statistics */
+    unsigned int slabs;
+    unsigned int live;
+    unsigned int allocs;
+    unsigned int frees;
+
+    struct kmem_cache *next;    /* all caches, for kmem_stats() */
+};
+
+/* Named cache for one kind of object. ctor runs once per object per slab */
+struct kmem_cache *kmem_cache_create(const char *name, size_t size, size_t align,
+                                     void (*ctor)(void *obj));
+void *kmem_cache_alloc(struct kmem_cache *cache);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+
+/* Give the empty slabs of a cache back to the page allocator */
+void kmem_cache_shrink(struct kmem_cache *cache);
+
+void *kmalloc(size_t size);
+void kfree(void *ptr);
+
+/* Print per-cache statistics on stdout */
+void kmem_cache_stats(struct kmem_cache *cache);
+void kmem_stats(void);
+
+/*
+ * Provided by the kernel: 2^order virtually contiguous pages aligned to
+ * their own size, or NULL when out of memory.
+ */
+void *kpage_alloc(unsigned int order);
+void kpage_free(void *addr, unsigned int order);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
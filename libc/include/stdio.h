@@ -3,6 +3,9 @@
 
 #include <sys/cdefs.h>
 
+#include <stdarg.h>
+#include <stddef.h>
+
 #define EOF (-1)
 
 #ifdef __cplusplus
@@ -10,6 +13,10 @@ extern "C" {
 #endif
 
 int printf(const char* __restrict, ...);
+int vprintf(const char* __restrict, va_list);
+int sprintf(char* __restrict, const char* __restrict, ...);
+int snprintf(char* __restrict, size_t, const char* __restrict, ...);
+int vsnprintf(char* __restrict, size_t, const char* __restrict, va_list);
 int putchar(int);
 int puts(const char*);
 
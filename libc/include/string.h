@@ -9,11 +9,14 @@
 extern "C" {
 #endif
 
+void* memchr(const void*, int, size_t);
 int memcmp(const void*, const void*, size_t);
 void* memcpy(void* __restrict, const void* __restrict, size_t);
 void* memmove(void*, const void*, size_t);
 void* memset(void*, int, size_t);
+char* strchr(const char*, int);
 size_t strlen(const char*);
+int strncmp(const char*, const char*, size_t);
 
 // Testing for buffer overruns
 char *strcpy(char *dest, const char *src);
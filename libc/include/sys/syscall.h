@@ -0,0 +1,34 @@
+#ifndef _SYS_SYSCALL_H
+#define _SYS_SYSCALL_H 1
+
+/*
+ * System call numbers, shared with the kernel. The number goes in eax,
+ * up to three arguments after it, the result comes back in eax.
+ */
+#define SYS_null  0
+#define SYS_exit  1
+#define SYS_write 2
+#define SYS_yield 3
+#define SYS_fork  4
+
+#define SYSCALL_MAX 5
+
+#ifndef __ASSEMBLER__
+
+#include <sys/cdefs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if !defined(__is_libk) && !defined(__is_kernel)
+long syscall(long, long, long, long);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef _SYS_TYPES_H
+#define _SYS_TYPES_H 1
+
+#include <sys/cdefs.h>
+
+typedef int ssize_t;
+typedef int pid_t;
+
+#endif
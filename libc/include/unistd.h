@@ -0,0 +1,22 @@
+#ifndef _UNISTD_H
+#define _UNISTD_H 1
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+__attribute__((__noreturn__))
+void _exit(int);
+pid_t fork(void);
+ssize_t write(int, const void*, size_t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
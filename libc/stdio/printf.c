@@ -1,80 +1,402 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
+#if defined(__is_libk)
+#include <kernel/tty.h>
+#include <kernel/printk.h>
+#endif
+
 static bool print(const char* data, size_t length) {
+#if defined(__is_libk)
+	/* whole spans, the terminal copies printable runs in bulk */
+	console_lock();
+	terminal_write(data, length);
+	console_unlock();
+	return true;
+#else
 	const unsigned char* bytes = (const unsigned char*) data;
 	for (size_t i = 0; i < length; i++)
 		if (putchar(bytes[i]) == EOF)
 			return false;
 	return true;
+#endif
 }
 
-int printf(const char* restrict format, ...) {
-	va_list parameters;
-	va_start(parameters, format);
+/*
+ * Where the formatter puts its output: a buffer that is either handed to
+ * 'flush' when full (printf) or truncated (snprintf). Nothing is allocated,
+ * 'total' counts what would have been written either way.
+ */
+struct out {
+	char* buf;
+	size_t size;
+	size_t len;
+	size_t total;
+	bool (*flush)(const char*, size_t);
+	bool error;
+};
 
-	int written = 0;
+static void out_write(struct out* o, const char* data, size_t length) {
+	o->total += length;
+	while (length) {
+		if (o->len == o->size) {
+			if (!o->flush)
+				return;
+			if (!o->flush(o->buf, o->len))
+				o->error = true;
+			o->len = 0;
+		}
+		size_t n = o->size - o->len;
+		if (n > length)
+			n = length;
+		for (size_t i = 0; i < n; i++)
+			o->buf[o->len + i] = data[i];
+		o->len += n;
+		data += n;
+		length -= n;
+	}
+}
 
-	while (*format != '\0') {
-		size_t maxrem = INT_MAX - written;
+static void out_pad(struct out* o, char c, int count) {
+	char pad[16];
+	for (size_t i = 0; i < sizeof(pad); i++)
+		pad[i] = c;
+	while (count > 0) {
+		int n = count < (int) sizeof(pad) ? count : (int) sizeof(pad);
+		out_write(o, pad, n);
+		count -= n;
+	}
+}
+
+/* ======== Integer conversion ======== */
+
+static const char digit_pairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/*
+ * Decimal digits of a 32-bit value, written backwards ending at 'end', two
+ * at a time. Division by the constant 100 compiles to a multiply.
+ */
+static char* format_u32(uint32_t value, char* end) {
+	while (value >= 100) {
+		uint32_t q = value / 100;
+		uint32_t r = value - q * 100;
+		end -= 2;
+		end[0] = digit_pairs[r * 2];
+		end[1] = digit_pairs[r * 2 + 1];
+		value = q;
+	}
+	if (value >= 10) {
+		end -= 2;
+		end[0] = digit_pairs[value * 2];
+		end[1] = digit_pairs[value * 2 + 1];
+	} else {
+		*--end = '0' + value;
+	}
+	return end;
+}
+
+/*
+ * 64-bit values are split into 9-digit chunks by dividing by 10^9, so the
+ * digits themselves are 32-bit work. On i386 the 10^9 division is one divl
+ * per 32-bit half rather than a call to the libgcc 64-bit divide.
+ */
+static char* format_u64(uint64_t value, char* end) {
+	while (value >> 32) {
+		uint32_t rem;
+#if defined(__i386__)
+		uint32_t hi = value >> 32, lo = (uint32_t) value, qlo;
+		uint32_t qhi = hi / 1000000000;
+		rem = hi - qhi * 1000000000;
+		/* rem < 10^9, so the quotient fits in 32 bits */
+		__asm__ ("divl %4" : "=a" (qlo), "=d" (rem) : "a" (lo), "d" (rem), "rm" (1000000000u));
+		value = (uint64_t) qhi << 32 | qlo;
+#else
+		rem = value % 1000000000;
+		value /= 1000000000;
+#endif
+		char* start = end - 9;
+		char* p = format_u32(rem, end);
+		while (p > start)
+			*--p = '0';
+		end = start;
+	}
+	return format_u32((uint32_t) value, end);
+}
+
+/* hexadecimal and octal: 'shift' bits per digit */
+static char* format_pow2(uint64_t value, char* end, int shift, bool upper) {
+	const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	unsigned int mask = (1u << shift) - 1;
+	do {
+		*--end = digits[value & mask];
+		value >>= shift;
+	} while (value);
+	return end;
+}
+
+/* ======== Formatter ======== */
 
+#define FLAG_LEFT  0x01
+#define FLAG_ZERO  0x02
+#define FLAG_PLUS  0x04
+#define FLAG_SPACE 0x08
+#define FLAG_ALT   0x10
+
+enum length { LEN_INT, LEN_CHAR, LEN_SHORT, LEN_LONG, LEN_LLONG, LEN_SIZE };
+
+static void format_integer(struct out* o, uint64_t value, bool negative, char conv,
+			   int flags, int width, int precision) {
+	char digits[24];
+	char* end = digits + sizeof(digits);
+	char* start;
+	char prefix[2];
+	int prefix_len = 0;
+
+	if (conv == 'x' || conv == 'X' || conv == 'p')
+		start = format_pow2(value, end, 4, conv == 'X');
+	else if (conv == 'o')
+		start = format_pow2(value, end, 3, false);
+	else
+		start = format_u64(value, end);
+
+	/* an explicit zero precision prints no digits for zero */
+	if (precision == 0 && value == 0)
+		start = end;
+
+	if (negative)
+		prefix[prefix_len++] = '-';
+	else if (flags & FLAG_PLUS)
+		prefix[prefix_len++] = '+';
+	else if (flags & FLAG_SPACE)
+		prefix[prefix_len++] = ' ';
+	else if (conv == 'p' || ((flags & FLAG_ALT) && value && (conv == 'x' || conv == 'X'))) {
+		prefix[prefix_len++] = '0';
+		prefix[prefix_len++] = conv == 'X' ? 'X' : 'x';
+	} else if ((flags & FLAG_ALT) && conv == 'o' && (start == end || *start != '0'))
+		*--start = '0';
+
+	int ndigits = end - start;
+	int zeros = precision > ndigits ? precision - ndigits : 0;
+	int fill = width - prefix_len - zeros - ndigits;
+
+	if ((flags & FLAG_ZERO) && !(flags & FLAG_LEFT) && precision < 0 && fill > 0) {
+		zeros += fill;
+		fill = 0;
+	}
+
+	if (!(flags & FLAG_LEFT))
+		out_pad(o, ' ', fill);
+	out_write(o, prefix, prefix_len);
+	out_pad(o, '0', zeros);
+	out_write(o, start, ndigits);
+	if (flags & FLAG_LEFT)
+		out_pad(o, ' ', fill);
+}
+
+static void vformat(struct out* o, const char* restrict format, va_list parameters) {
+	while (*format != '\0') {
 		if (format[0] != '%' || format[1] == '%') {
 			if (format[0] == '%')
 				format++;
 			size_t amount = 1;
 			while (format[amount] && format[amount] != '%')
 				amount++;
-			if (maxrem < amount) {
-				// TODO: Set errno to EOVERFLOW.
-				return -1;
-			}
-			if (!print(format, amount))
-				return -1;
+			out_write(o, format, amount);
 			format += amount;
-			written += amount;
 			continue;
 		}
 
 		const char* format_begun_at = format++;
 
-		if (*format == 'c') {
+		int flags = 0;
+		for (;; format++) {
+			if (*format == '-')
+				flags |= FLAG_LEFT;
+			else if (*format == '0')
+				flags |= FLAG_ZERO;
+			else if (*format == '+')
+				flags |= FLAG_PLUS;
+			else if (*format == ' ')
+				flags |= FLAG_SPACE;
+			else if (*format == '#')
+				flags |= FLAG_ALT;
+			else
+				break;
+		}
+
+		int width = 0;
+		if (*format == '*') {
 			format++;
-			char c = (char) va_arg(parameters, int /* char promotes to int */);
-			if (!maxrem) {
-				// TODO: Set errno to EOVERFLOW.
-				return -1;
+			width = va_arg(parameters, int);
+			if (width < 0) {
+				flags |= FLAG_LEFT;
+				width = -width;
 			}
-			if (!print(&c, sizeof(c)))
-				return -1;
-			written++;
-		} else if (*format == 's') {
+		} else {
+			while (*format >= '0' && *format <= '9')
+				width = width * 10 + (*format++ - '0');
+		}
+
+		int precision = -1;
+		if (*format == '.') {
+			format++;
+			precision = 0;
+			if (*format == '*') {
+				format++;
+				precision = va_arg(parameters, int);
+				if (precision < 0)
+					precision = -1;
+			} else {
+				while (*format >= '0' && *format <= '9')
+					precision = precision * 10 + (*format++ - '0');
+			}
+		}
+
+		enum length length = LEN_INT;
+		if (*format == 'h') {
+			format++;
+			length = LEN_SHORT;
+			if (*format == 'h') {
+				format++;
+				length = LEN_CHAR;
+			}
+		} else if (*format == 'l') {
+			format++;
+			length = LEN_LONG;
+			if (*format == 'l') {
+				format++;
+				length = LEN_LLONG;
+			}
+		} else if (*format == 'z' || *format == 't') {
+			format++;
+			length = LEN_SIZE;
+		} else if (*format == 'j') {
+			format++;
+			length = LEN_LLONG;
+		}
+
+		char conv = *format;
+		if (conv == 'c') {
+			format++;
+			char c = (char) va_arg(parameters, int /* char promotes to int */);
+			if (!(flags & FLAG_LEFT))
+				out_pad(o, ' ', width - 1);
+			out_write(o, &c, 1);
+			if (flags & FLAG_LEFT)
+				out_pad(o, ' ', width - 1);
+		} else if (conv == 's') {
 			format++;
 			const char* str = va_arg(parameters, const char*);
-			size_t len = strlen(str);
-			if (maxrem < len) {
-				// TODO: Set errno to EOVERFLOW.
-				return -1;
+			if (!str)
+				str = "(null)";
+			size_t len = 0;
+			while (str[len] && (precision < 0 || len < (size_t) precision))
+				len++;
+			if (!(flags & FLAG_LEFT))
+				out_pad(o, ' ', width - (int) len);
+			out_write(o, str, len);
+			if (flags & FLAG_LEFT)
+				out_pad(o, ' ', width - (int) len);
+		} else if (conv == 'd' || conv == 'i') {
+			format++;
+			int64_t value;
+			switch (length) {
+			case LEN_CHAR: value = (signed char) va_arg(parameters, int); break;
+			case LEN_SHORT: value = (short) va_arg(parameters, int); break;
+			case LEN_LONG: value = va_arg(parameters, long); break;
+			case LEN_LLONG: value = va_arg(parameters, long long); break;
+			case LEN_SIZE: value = va_arg(parameters, ptrdiff_t); break;
+			default: value = va_arg(parameters, int); break;
 			}
-			if (!print(str, len))
-				return -1;
-			written += len;
-		} else {
-			format = format_begun_at;
-			size_t len = strlen(format);
-			if (maxrem < len) {
-				// TODO: Set errno to EOVERFLOW.
-				return -1;
+			/* negate as unsigned, INT64_MIN has no positive counterpart */
+			uint64_t magnitude = value < 0 ? -(uint64_t) value : (uint64_t) value;
+			format_integer(o, magnitude, value < 0, 'd', flags, width, precision);
+		} else if (conv == 'u' || conv == 'x' || conv == 'X' || conv == 'o') {
+			format++;
+			uint64_t value;
+			switch (length) {
+			case LEN_CHAR: value = (unsigned char) va_arg(parameters, unsigned int); break;
+			case LEN_SHORT: value = (unsigned short) va_arg(parameters, unsigned int); break;
+			case LEN_LONG: value = va_arg(parameters, unsigned long); break;
+			case LEN_LLONG: value = va_arg(parameters, unsigned long long); break;
+			case LEN_SIZE: value = va_arg(parameters, size_t); break;
+			default: value = va_arg(parameters, unsigned int); break;
 			}
-			if (!print(format, len))
-				return -1;
-			written += len;
-			format += len;
+			format_integer(o, value, false, conv, flags & ~(FLAG_PLUS | FLAG_SPACE), width, precision);
+		} else if (conv == 'p') {
+			format++;
+			uintptr_t value = (uintptr_t) va_arg(parameters, void*);
+			format_integer(o, value, false, 'p', flags & ~(FLAG_PLUS | FLAG_SPACE), width, precision);
+		} else {
+			/* not a conversion we know, print it as it stands */
+			if (conv)
+				format++;
+			out_write(o, format_begun_at, format - format_begun_at);
 		}
 	}
+}
+
+/* ======== Entry points ======== */
+
+int vsnprintf(char* restrict buf, size_t size, const char* restrict fmt, va_list parameters) {
+	struct out o = { buf, size ? size - 1 : 0, 0, 0, NULL, false };
+
+	vformat(&o, fmt, parameters);
+	if (size)
+		buf[o.len] = '\0';
+	// TODO: Set errno to EOVERFLOW.
+	return o.total > INT_MAX ? -1 : (int) o.total;
+}
+
+int snprintf(char* restrict buf, size_t size, const char* restrict fmt, ...) {
+	va_list parameters;
+	va_start(parameters, fmt);
+	int written = vsnprintf(buf, size, fmt, parameters);
+	va_end(parameters);
+	return written;
+}
 
+int sprintf(char* restrict buf, const char* restrict fmt, ...) {
+	va_list parameters;
+	va_start(parameters, fmt);
+	int written = vsnprintf(buf, (size_t) INT_MAX + 1, fmt, parameters);
+	va_end(parameters);
+	return written;
+}
+
+/* Output goes out in chunks of this size, from the stack */
+#define PRINTF_BUFFER 128
+
+int vprintf(const char* restrict fmt, va_list parameters) {
+	char buf[PRINTF_BUFFER];
+	struct out o = { buf, sizeof(buf), 0, 0, print, false };
+
+	vformat(&o, fmt, parameters);
+	if (o.len && !print(buf, o.len))
+		o.error = true;
+	// TODO: Set errno to EOVERFLOW.
+	return o.error || o.total > INT_MAX ? -1 : (int) o.total;
+}
+
+int printf(const char* restrict fmt, ...) {
+	va_list parameters;
+	va_start(parameters, fmt);
+	int written = vprintf(fmt, parameters);
 	va_end(parameters);
 	return written;
 }
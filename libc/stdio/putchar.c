@@ -2,14 +2,21 @@
 
 #if defined(__is_libk)
 #include <kernel/tty.h>
+#include <kernel/printk.h>
+#else
+#include <unistd.h>
 #endif
 
 int putchar(int ic) {
-#if defined(__is_libk)
 	char c = (char) ic;
+#if defined(__is_libk)
+	console_lock();
 	terminal_write(&c, sizeof(c));
+	console_unlock();
 #else
-	// TODO: Implement stdio and the write system call.
+	// TODO: Buffer stdout instead of a system call per character.
+	if (write(1, &c, 1) != 1)
+		return EOF;
 #endif
 	return ic;
 }
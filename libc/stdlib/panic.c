@@ -2,15 +2,23 @@
 #include <stdlib.h>
 #include <signal.h>
 
+#if defined(__is_libk)
+#include <kernel/printk.h>
+#endif
+
 char *panic_str;
 
 __attribute__((__noreturn__))
 void panic(char *s) {
   panic_str = s; 
 
-  /* Sync HERE */
-
+#if defined(__is_libk)
+  /* nothing is going to drain the log for us any more */
+  printk(LOG_EMERG, "kernel panic: %s\n", s);
+  console_flush_on_panic();
+#else
   printf("kernel panic: %s\n", s);
+#endif
   
 	while (1) { }
 	__builtin_unreachable();
@@ -0,0 +1,287 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <slab.h>
+
+#if defined(__is_libk)
+#include <kernel/system.h>
+/* threads and interrupt handlers share the caches */
+#define slab_lock() irq_save()
+#define slab_unlock(flags) irq_restore(flags)
+#else
+#define slab_lock() 0u
+#define slab_unlock(flags) ((void) (flags))
+#endif
+
+#define SLAB_END 0xFFFF
+
+/*
+ * Sits at the start of every SLAB_SIZE aligned slab. A large kmalloc block
+ * only has the first two fields, its data starts at KMALLOC_LARGE_OFFSET.
+ */
+struct kmem_slab {
+	struct kmem_cache *cache;	/* NULL for a large kmalloc block */
+	unsigned int order;		/* page order of the block */
+	struct kmem_slab *prev;
+	struct kmem_slab *next;
+	unsigned int inuse;
+	uint16_t free;			/* first free object, SLAB_END if none */
+	uint16_t bufctl[];		/* next free object after each free one */
+};
+
+/* Large blocks keep 16 byte alignment behind their header */
+#define KMALLOC_LARGE_OFFSET 16
+
+#define KMALLOC_CACHES (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+
+static const char *kmalloc_names[KMALLOC_CACHES] = {
+	"kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128", "kmalloc-256",
+	"kmalloc-512", "kmalloc-1024", "kmalloc-2048", "kmalloc-4096",
+};
+
+static struct kmem_cache kmalloc_caches[KMALLOC_CACHES];
+static struct kmem_cache cache_cache;	/* holds caches from kmem_cache_create */
+static struct kmem_cache *cache_list;
+static int kmalloc_ready;
+
+static size_t align_up(size_t n, size_t align) {
+	return (n + align - 1) & ~(align - 1);
+}
+
+static void slab_list_add(struct kmem_slab **head, struct kmem_slab *slab) {
+	slab->prev = NULL;
+	slab->next = *head;
+	if (*head)
+		(*head)->prev = slab;
+	*head = slab;
+}
+
+static void slab_list_del(struct kmem_slab **head, struct kmem_slab *slab) {
+	if (slab->prev)
+		slab->prev->next = slab->next;
+	else
+		*head = slab->next;
+	if (slab->next)
+		slab->next->prev = slab->prev;
+}
+
+static void *slab_obj(struct kmem_cache *cache, struct kmem_slab *slab, unsigned int i) {
+	return (char *) slab + cache->offset + i * cache->size;
+}
+
+static struct kmem_slab *slab_of(void *obj) {
+	return (struct kmem_slab *) ((uintptr_t) obj & ~(uintptr_t) (SLAB_SIZE - 1));
+}
+
+static int cache_init(struct kmem_cache *cache, const char *name, size_t size,
+		      size_t align, void (*ctor)(void *)) {
+	if (align < sizeof(void *))
+		align = sizeof(void *);
+	if (align & (align - 1))
+		return 0;
+	size = align_up(size ? size : 1, align);
+
+	/* as many objects as fit after the header and its index array */
+	size_t hdr = sizeof(struct kmem_slab);
+	unsigned int n = (SLAB_SIZE - hdr) / (size + sizeof(uint16_t));
+	while (n && align_up(hdr + n * sizeof(uint16_t), align) + n * size > SLAB_SIZE)
+		n--;
+	if (!n)
+		return 0;
+
+	cache->name = name;
+	cache->size = size;
+	cache->align = align;
+	cache->offset = align_up(hdr + n * sizeof(uint16_t), align);
+	cache->per_slab = n;
+	cache->ctor = ctor;
+	cache->partial = cache->full = cache->empty = NULL;
+	cache->slabs = cache->live = cache->allocs = cache->frees = 0;
+
+	cache->next = cache_list;
+	cache_list = cache;
+	return 1;
+}
+
+static void kmalloc_init(void) {
+	for (int i = KMALLOC_CACHES - 1; i >= 0; i--)
+		cache_init(&kmalloc_caches[i], kmalloc_names[i],
+			   1 << (KMALLOC_MIN_SHIFT + i), 16, NULL);
+	cache_init(&cache_cache, "kmem_cache", sizeof(struct kmem_cache), 0, NULL);
+	kmalloc_ready = 1;
+}
+
+/* New slab: build the free chain and run the constructor once per object */
+static struct kmem_slab *cache_grow(struct kmem_cache *cache) {
+	struct kmem_slab *slab = kpage_alloc(SLAB_ORDER);
+	if (!slab)
+		return NULL;
+
+	slab->cache = cache;
+	slab->inuse = 0;
+	slab->order = SLAB_ORDER;
+	slab->free = 0;
+	for (unsigned int i = 0; i < cache->per_slab; i++) {
+		slab->bufctl[i] = (i + 1 < cache->per_slab) ? i + 1 : SLAB_END;
+		if (cache->ctor)
+			cache->ctor(slab_obj(cache, slab, i));
+	}
+
+	cache->slabs++;
+	return slab;
+}
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size, size_t align,
+				     void (*ctor)(void *obj)) {
+	if (!kmalloc_ready)
+		kmalloc_init();
+
+	struct kmem_cache *cache = kmem_cache_alloc(&cache_cache);
+	if (!cache)
+		return NULL;
+	if (!cache_init(cache, name, size, align, ctor)) {
+		kmem_cache_free(&cache_cache, cache);
+		return NULL;
+	}
+	return cache;
+}
+
+static void *cache_alloc(struct kmem_cache *cache) {
+	struct kmem_slab *slab = cache->partial;
+
+	if (!slab) {
+		slab = cache->empty;
+		if (slab)
+			slab_list_del(&cache->empty, slab);
+		else if (!(slab = cache_grow(cache)))
+			return NULL;
+		slab_list_add(&cache->partial, slab);
+	}
+
+	unsigned int i = slab->free;
+	slab->free = slab->bufctl[i];
+	slab->inuse++;
+	if (slab->free == SLAB_END) {
+		slab_list_del(&cache->partial, slab);
+		slab_list_add(&cache->full, slab);
+	}
+
+	cache->live++;
+	cache->allocs++;
+	return slab_obj(cache, slab, i);
+}
+
+static void cache_free(struct kmem_cache *cache, void *obj) {
+	struct kmem_slab *slab = slab_of(obj);
+
+	if (slab->cache != cache)
+		panic("kmem_cache_free: object does not belong to cache");
+
+	unsigned int i = ((char *) obj - (char *) slab - cache->offset) / cache->size;
+
+	if (slab->free == SLAB_END) {
+		slab_list_del(&cache->full, slab);
+		slab_list_add(&cache->partial, slab);
+	}
+	slab->bufctl[i] = slab->free;
+	slab->free = i;
+	slab->inuse--;
+
+	cache->live--;
+	cache->frees++;
+
+	/* keep one empty slab around so alloc/free at a boundary doesn't thrash */
+	if (!slab->inuse) {
+		slab_list_del(&cache->partial, slab);
+		if (cache->empty) {
+			kpage_free(slab, SLAB_ORDER);
+			cache->slabs--;
+		} else {
+			slab_list_add(&cache->empty, slab);
+		}
+	}
+}
+
+void *kmem_cache_alloc(struct kmem_cache *cache) {
+	unsigned int flags = slab_lock();
+	void *obj = cache_alloc(cache);
+	slab_unlock(flags);
+	return obj;
+}
+
+void kmem_cache_free(struct kmem_cache *cache, void *obj) {
+	unsigned int flags = slab_lock();
+	cache_free(cache, obj);
+	slab_unlock(flags);
+}
+
+void kmem_cache_shrink(struct kmem_cache *cache) {
+	unsigned int flags = slab_lock();
+	while (cache->empty) {
+		struct kmem_slab *slab = cache->empty;
+		slab_list_del(&cache->empty, slab);
+		kpage_free(slab, SLAB_ORDER);
+		cache->slabs--;
+	}
+	slab_unlock(flags);
+}
+
+/* Bigger than any size class: whole pages, SLAB_SIZE aligned, with a header */
+static void *kmalloc_large(size_t size) {
+	unsigned int order = SLAB_ORDER;
+
+	size += KMALLOC_LARGE_OFFSET;
+	while (((size_t) 4096 << order) < size)
+		order++;
+
+	struct kmem_slab *block = kpage_alloc(order);
+	if (!block)
+		return NULL;
+	block->cache = NULL;
+	block->order = order;
+	return (char *) block + KMALLOC_LARGE_OFFSET;
+}
+
+void *kmalloc(size_t size) {
+	if (!kmalloc_ready)
+		kmalloc_init();
+	if (!size)
+		return NULL;
+	if (size > KMALLOC_MAX_SIZE)
+		return kmalloc_large(size);
+
+	unsigned int shift = KMALLOC_MIN_SHIFT;
+	if (size > (1u << KMALLOC_MIN_SHIFT))
+		shift = 32 - __builtin_clz(size - 1);
+
+	return kmem_cache_alloc(&kmalloc_caches[shift - KMALLOC_MIN_SHIFT]);
+}
+
+void kfree(void *ptr) {
+	if (!ptr)
+		return;
+
+	struct kmem_slab *slab = slab_of(ptr);
+	if (!slab->cache)
+		kpage_free(slab, slab->order);
+	else
+		kmem_cache_free(slab->cache, ptr);
+}
+
+void kmem_cache_stats(struct kmem_cache *cache) {
+	unsigned long long used = (unsigned long long) cache->live * cache->size;
+	unsigned long long total = (unsigned long long) cache->slabs * SLAB_SIZE;
+
+	/* share of slab memory not holding a live object */
+	unsigned int frag = total ? 100 - (unsigned int) (used * 100 / total) : 0;
+
+	printf("%s: %u B, %u/slab, %u slabs, %u live, %u%% frag\n", cache->name,
+	       (unsigned int) cache->size, cache->per_slab, cache->slabs, cache->live, frag);
+}
+
+void kmem_stats(void) {
+	if (!kmalloc_ready)
+		kmalloc_init();
+	for (struct kmem_cache *cache = cache_list; cache; cache = cache->next)
+		kmem_cache_stats(cache);
+}
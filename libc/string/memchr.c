@@ -0,0 +1,25 @@
+#include <string.h>
+
+#include "word.h"
+
+void* memchr(const void* ptr, int value, size_t size) {
+	const unsigned char* p = (const unsigned char*) ptr;
+	unsigned char c = (unsigned char) value;
+
+	for (; size && !word_aligned(p); size--, p++)
+		if (*p == c)
+			return (void*) p;
+
+	/* bytes equal to c are the zero bytes of w ^ pattern */
+	word_t pattern = word_repeat(c);
+	for (; size >= WORD_SIZE; size -= WORD_SIZE, p += WORD_SIZE) {
+		word_t found = word_has_zero(*(const word_t*) p ^ pattern);
+		if (found)
+			return (void*) (p + word_first(found));
+	}
+
+	for (; size; size--, p++)
+		if (*p == c)
+			return (void*) p;
+	return NULL;
+}
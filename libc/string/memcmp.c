@@ -1,8 +1,18 @@
 #include <string.h>
 
+#include "word.h"
+
 int memcmp(const void* aptr, const void* bptr, size_t size) {
 	const unsigned char* a = (const unsigned char*) aptr;
 	const unsigned char* b = (const unsigned char*) bptr;
+
+	/* x86 loads unaligned words at full speed, the bytes decide once two differ */
+	for (; size >= WORD_SIZE; size -= WORD_SIZE) {
+		if (*(const uword_t*) a != *(const uword_t*) b)
+			break;
+		a += WORD_SIZE;
+		b += WORD_SIZE;
+	}
 	for (size_t i = 0; i < size; i++) {
 		if (a[i] < b[i])
 			return -1;
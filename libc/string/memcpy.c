@@ -1,9 +1,60 @@
+#include <stdint.h>
 #include <string.h>
 
+#include "word.h"
+
+#if defined(__is_libk)
+#include <kernel/fpu.h>
+#endif
+
+/*
+ * Copies forwards, from the lowest address up; memmove relies on that when
+ * the destination starts below an overlapping source.
+ */
 void* memcpy(void* restrict dstptr, const void* restrict srcptr, size_t size) {
 	unsigned char* dst = (unsigned char*) dstptr;
 	const unsigned char* src = (const unsigned char*) srcptr;
-	for (size_t i = 0; i < size; i++)
-		dst[i] = src[i];
+
+#if defined(__i386__)
+#if defined(__is_libk)
+	/* big copies would only evict the cache, stream them past it */
+	if (size >= FPU_COPY_MIN && fpu_sse2) {
+		size_t head = -(uintptr_t) dst & 15;
+		size -= head;
+		__asm__ __volatile__ ("rep movsb"
+				      : "+D" (dst), "+S" (src), "+c" (head) : : "memory");
+		size_t done = fpu_copy(dst, src, size);
+		dst += done;
+		src += done;
+		size -= done;
+	}
+#endif
+	/* below this, setting up a string move costs more than it saves */
+	if (size >= 16) {
+		size_t head = -(uintptr_t) dst & 3;
+		size -= head;
+		size_t words = size >> 2;
+		size &= 3;
+		__asm__ __volatile__ ("rep movsb\n\t"
+				      "mov %3, %%ecx\n\t"
+				      "rep movsl"
+				      : "+D" (dst), "+S" (src), "+c" (head)
+				      : "r" (words) : "memory");
+	}
+#else
+	/* words only line up in both when the pointers agree modulo a word */
+	if (size >= 2 * WORD_SIZE
+	    && ((uintptr_t) dst - (uintptr_t) src) % WORD_SIZE == 0) {
+		for (; !word_aligned(dst); size--)
+			*dst++ = *src++;
+		for (; size >= WORD_SIZE; size -= WORD_SIZE) {
+			*(word_t*) dst = *(const word_t*) src;
+			dst += WORD_SIZE;
+			src += WORD_SIZE;
+		}
+	}
+#endif
+	while (size--)
+		*dst++ = *src++;
 	return dstptr;
 }
@@ -1,14 +1,34 @@
+#include <stdint.h>
 #include <string.h>
 
 void* memmove(void* dstptr, const void* srcptr, size_t size) {
 	unsigned char* dst = (unsigned char*) dstptr;
 	const unsigned char* src = (const unsigned char*) srcptr;
-	if (dst < src) {
-		for (size_t i = 0; i < size; i++)
-			dst[i] = src[i];
-	} else {
-		for (size_t i = size; i != 0; i--)
-			dst[i-1] = src[i-1];
+
+	/* memcpy goes forwards, safe unless dst lies inside the source */
+	if (dst <= src || dst >= src + size)
+		return memcpy(dstptr, srcptr, size);
+
+	dst += size;
+	src += size;
+#if defined(__i386__)
+	if (size >= 16) {
+		/* the ends down to an aligned destination, then dwords from the top */
+		for (size_t tail = (uintptr_t) dst & 3; tail; tail--, size--)
+			*--dst = *--src;
+		size_t words = size >> 2;
+		size &= 3;
+		dst -= 4;
+		src -= 4;
+		__asm__ __volatile__ ("std\n\t"
+				      "rep movsl\n\t"
+				      "cld"
+				      : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+		dst += 4;
+		src += 4;
 	}
+#endif
+	while (size--)
+		*--dst = *--src;
 	return dstptr;
 }
@@ -1,8 +1,53 @@
+#include <stdint.h>
 #include <string.h>
 
+#include "word.h"
+
+#if defined(__is_libk)
+#include <kernel/fpu.h>
+#endif
+
 void* memset(void* bufptr, int value, size_t size) {
 	unsigned char* buf = (unsigned char*) bufptr;
-	for (size_t i = 0; i < size; i++)
-		buf[i] = (unsigned char) value;
+
+#if defined(__i386__)
+	/* the byte in all four lanes, stosb only looks at the low one */
+	uint32_t pattern = (unsigned char) value * 0x01010101u;
+
+#if defined(__is_libk)
+	if (size >= FPU_COPY_MIN && fpu_sse2) {
+		size_t head = -(uintptr_t) buf & 15;
+		size -= head;
+		__asm__ __volatile__ ("rep stosb"
+				      : "+D" (buf), "+c" (head) : "a" (pattern) : "memory");
+		size_t done = fpu_fill(buf, pattern, size);
+		buf += done;
+		size -= done;
+	}
+#endif
+	if (size >= 16) {
+		size_t head = -(uintptr_t) buf & 3;
+		size -= head;
+		size_t words = size >> 2;
+		size &= 3;
+		__asm__ __volatile__ ("rep stosb\n\t"
+				      "mov %2, %%ecx\n\t"
+				      "rep stosl"
+				      : "+D" (buf), "+c" (head)
+				      : "r" (words), "a" (pattern) : "memory");
+	}
+#else
+	if (size >= 2 * WORD_SIZE) {
+		word_t pattern = word_repeat(value);
+		for (; !word_aligned(buf); size--)
+			*buf++ = (unsigned char) value;
+		for (; size >= WORD_SIZE; size -= WORD_SIZE) {
+			*(word_t*) buf = pattern;
+			buf += WORD_SIZE;
+		}
+	}
+#endif
+	while (size--)
+		*buf++ = (unsigned char) value;
 	return bufptr;
 }
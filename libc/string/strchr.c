@@ -0,0 +1,25 @@
+#include <string.h>
+
+#include "word.h"
+
+char* strchr(const char* str, int value) {
+	const char* s = str;
+	char c = (char) value;
+
+	for (; !word_aligned(s); s++) {
+		if (*s == c)
+			return (char*) s;
+		if (!*s)
+			return NULL;
+	}
+
+	/* stop at the first word holding either c or the terminator */
+	word_t pattern = word_repeat(c);
+	const word_t* w = (const word_t*) s;
+	word_t found;
+	while (!(found = word_has_zero(*w) | word_has_zero(*w ^ pattern)))
+		w++;
+
+	s = (const char*) w + word_first(found);
+	return *s == c ? (char*) s : NULL;
+}
@@ -1,12 +1,19 @@
 #include <string.h>
 
+#include "word.h"
+
 char *strcpy(char *dest, const char *src) {
-  size_t i;
-  size_t n = strlen(src);
-
-  for (i = 0; i < n && src[i] != '\0'; i++) 
-    dest[i] = src[i];
-  for (; i < n; i++) 
-    dest[i] = '\0';
-  return dest;
+	char *d = dest;
+
+	for (; !word_aligned(src); src++, d++)
+		if (!(*d = *src))
+			return dest;
+
+	/* whole words until the one holding the terminator */
+	for (; !word_has_zero(*(const word_t *) src); src += WORD_SIZE, d += WORD_SIZE)
+		*(uword_t *) d = *(const word_t *) src;
+
+	while ((*d++ = *src++))
+		;
+	return dest;
 }
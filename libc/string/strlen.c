@@ -1,8 +1,16 @@
 #include <string.h>
 
+#include "word.h"
+
 size_t strlen(const char* str) {
-	size_t len = 0;
-	while (str[len])
-		len++;
-	return len;
+	const char* s = str;
+
+	for (; !word_aligned(s); s++)
+		if (!*s)
+			return s - str;
+
+	const word_t* w = (const word_t*) s;
+	while (!word_has_zero(*w))
+		w++;
+	return (const char*) w + word_first(word_has_zero(*w)) - str;
 }
@@ -0,0 +1,25 @@
+#include <string.h>
+
+#include "word.h"
+
+int strncmp(const char* aptr, const char* bptr, size_t n) {
+	const unsigned char* a = (const unsigned char*) aptr;
+	const unsigned char* b = (const unsigned char*) bptr;
+
+	/* words only when both strings reach alignment together */
+	if (((uintptr_t) a - (uintptr_t) b) % WORD_SIZE == 0) {
+		for (; n && !word_aligned(a); n--, a++, b++)
+			if (*a != *b || !*a)
+				return *a - *b;
+		for (; n >= WORD_SIZE; n -= WORD_SIZE, a += WORD_SIZE, b += WORD_SIZE) {
+			word_t w = *(const word_t*) a;
+			if (w != *(const word_t*) b || word_has_zero(w))
+				break;
+		}
+	}
+
+	for (; n; n--, a++, b++)
+		if (*a != *b || !*a)
+			return *a - *b;
+	return 0;
+}
@@ -1,12 +1,25 @@
 #include <string.h>
 
+#include "word.h"
+
 char *strncpy(char *dest, const char *src, size_t n) {
-  size_t i;
+	char *d = dest;
 
-  for (i = 0; i < n && src[i] != '\0'; i++) 
-    dest[i] = src[i];
-  for (; i < n; i++) 
-    dest[i] = '\0';
-  return dest;
-}
+	for (; n && !word_aligned(src); n--, src++, d++)
+		if (!(*d = *src))
+			break;
 
+	if (n && word_aligned(src)) {
+		for (; n >= WORD_SIZE && !word_has_zero(*(const word_t *) src); n -= WORD_SIZE) {
+			*(uword_t *) d = *(const word_t *) src;
+			src += WORD_SIZE;
+			d += WORD_SIZE;
+		}
+	}
+
+	for (; n && *src; n--)
+		*d++ = *src++;
+	/* the rest, terminator included, is zero */
+	memset(d, 0, n);
+	return dest;
+}
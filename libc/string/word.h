@@ -0,0 +1,43 @@
+#ifndef _LIBC_STRING_WORD_H
+#define _LIBC_STRING_WORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Word-at-a-time helpers for the string functions. A word read from an
+ * aligned address never crosses into the next page, so scanning past the
+ * terminator within that word cannot fault.
+ */
+
+/* Machine words that may alias any object, the second at any address */
+typedef size_t __attribute__((__may_alias__)) word_t;
+typedef size_t __attribute__((__may_alias__, __aligned__(1))) uword_t;
+
+#define WORD_SIZE  sizeof(word_t)
+#define WORD_ONES  ((word_t) -1 / 0xFF)     /* 0x01010101 */
+#define WORD_HIGHS (WORD_ONES << 7)         /* 0x80808080 */
+
+static inline int word_aligned(const void* ptr) {
+	return ((uintptr_t) ptr & (WORD_SIZE - 1)) == 0;
+}
+
+/* 'c' in every byte */
+static inline word_t word_repeat(unsigned char c) {
+	return c * WORD_ONES;
+}
+
+/*
+ * Nonzero when some byte of x is zero. A borrow may also flag bytes above
+ * the first zero byte, never below it, so the lowest flag is exact.
+ */
+static inline word_t word_has_zero(word_t x) {
+	return (x - WORD_ONES) & ~x & WORD_HIGHS;
+}
+
+/* Index of the byte holding the lowest flag, x86 being little-endian */
+static inline size_t word_first(word_t flags) {
+	return __builtin_ctzl(flags) / 8;
+}
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * Runs the registered tests, or the benchmarks with -b, and stands in for
+ * the kernel services libk calls into.
+ *
+ *     ./libk_test [-b] [name]
+ *
+ * 'name' picks the tests or benchmarks whose names contain it.
+ */
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "klib.h"
+#include "test.h"
+
+#define BENCH_SAMPLES   15
+#define BENCH_SAMPLE_NS 4000000         /* aim for 4 ms per sample */
+
+static struct test *tests, **tests_tail = &tests;
+static struct bench *benches, **benches_tail = &benches;
+static const char *current_test;
+static unsigned long failures;
+
+/* Kept in the order of the source files */
+void test_register(struct test *t) {
+	*tests_tail = t;
+	tests_tail = &t->next;
+}
+
+void bench_register(struct bench *b) {
+	*benches_tail = b;
+	benches_tail = &b->next;
+}
+
+void test_fail(const char *file, int line, const char *fmt, ...) {
+	va_list ap;
+
+	printf("FAIL %s (%s:%d): ", current_test, file, line);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+	failures++;
+}
+
+/* ======== What the kernel provides ======== */
+
+long kpage_live;
+
+void *kpage_alloc(unsigned int order) {
+	size_t size = (size_t) 4096 << order;
+	void *p = aligned_alloc(size, size);
+
+	if (p)
+		kpage_live += 1L << order;
+	return p;
+}
+
+void kpage_free(void *addr, unsigned int order) {
+	kpage_live -= 1L << order;
+	free(addr);
+}
+
+__attribute__((__noreturn__))
+void k_panic(char *s) {
+	printf("kernel panic in %s: %s\n", current_test ? current_test : "benchmark", s);
+	abort();
+}
+
+/* ======== Runners ======== */
+
+static long long now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long time_run(struct bench *b, unsigned long iterations) {
+	long long start = now_ns();
+	b->run(iterations);
+	return now_ns() - start;
+}
+
+static int by_value(const void *a, const void *b) {
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Grow the iteration count until a sample is long enough to time, then
+ * take BENCH_SAMPLES of them: the median is the result, the minimum and
+ * the relative standard deviation say how much to trust it.
+ */
+static void run_bench(struct bench *b) {
+	unsigned long iterations = 1;
+	long long elapsed;
+	double ns[BENCH_SAMPLES], mean = 0, var = 0;
+
+	while ((elapsed = time_run(b, iterations)) < BENCH_SAMPLE_NS / 8)
+		iterations *= 2;
+	iterations = iterations * (double) BENCH_SAMPLE_NS / (elapsed ? elapsed : 1) + 1;
+
+	for (int i = 0; i < BENCH_SAMPLES; i++) {
+		ns[i] = (double) time_run(b, iterations) / iterations;
+		mean += ns[i] / BENCH_SAMPLES;
+	}
+	for (int i = 0; i < BENCH_SAMPLES; i++)
+		var += (ns[i] - mean) * (ns[i] - mean) / (BENCH_SAMPLES - 1);
+	qsort(ns, BENCH_SAMPLES, sizeof(ns[0]), by_value);
+
+	printf("%-28s %12.2f %12.2f %7.1f%%\n", b->name, ns[BENCH_SAMPLES / 2], ns[0],
+	       mean ? 100 * sqrt(var) / mean : 0);
+}
+
+int main(int argc, char **argv) {
+	int bench = argc > 1 && !strcmp(argv[1], "-b");
+	const char *filter = argc > 1 + bench ? argv[1 + bench] : "";
+	unsigned long ran = 0;
+
+	if (bench) {
+		printf("%-28s %12s %12s %8s\n", "benchmark", "ns/op", "min", "stddev");
+		for (struct bench *b = benches; b; b = b->next)
+			if (strstr(b->name, filter))
+				run_bench(b);
+		return 0;
+	}
+
+	for (struct test *t = tests; t; t = t->next) {
+		if (!strstr(t->name, filter))
+			continue;
+		current_test = t->name;
+		t->run();
+		ran++;
+	}
+	current_test = NULL;
+
+	printf("libk_test: %lu tests, %lu failures\n", ran, failures);
+	return failures != 0;
+}
@@ -0,0 +1,29 @@
+#ifndef _LIBC_TEST_KLIB_H
+#define _LIBC_TEST_KLIB_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+/* The allocator's names are libk's own, nothing on the host has them */
+#include "../include/slab.h"
+
+/* libk's string and stdio functions as the Makefile renames them for the host */
+void* k_memchr(const void*, int, size_t);
+int k_memcmp(const void*, const void*, size_t);
+void* k_memcpy(void*, const void*, size_t);
+void* k_memmove(void*, const void*, size_t);
+void* k_memset(void*, int, size_t);
+char* k_strchr(const char*, int);
+char* k_strcpy(char*, const char*);
+size_t k_strlen(const char*);
+int k_strncmp(const char*, const char*, size_t);
+char* k_strncpy(char*, const char*, size_t);
+
+int k_sprintf(char*, const char*, ...);
+int k_snprintf(char*, size_t, const char*, ...);
+int k_vsnprintf(char*, size_t, const char*, va_list);
+
+/* Provided by the harness in place of the kernel: pages handed out so far */
+extern long kpage_live;
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ * Randomised differential test of libk's string functions against the host
+ * C library. Buffers end right before an inaccessible page, so reading
+ * past a terminator into the next page faults instead of going unnoticed.
+ *
+ *     ./string_fuzz [iterations [seed]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "klib.h"
+
+#define ARENA_PAGES 4
+
+static unsigned char *arena;            /* ARENA_PAGES readable, then a guard page */
+static size_t arena_size;
+static unsigned char ref[ARENA_PAGES * 65536];
+static unsigned long failures;
+
+static unsigned int rnd(unsigned int n) {
+	return n ? (unsigned int) random() % n : 0;
+}
+
+/* Mostly short, sometimes spanning many words and a page */
+static size_t rnd_len(void) {
+	switch (rnd(4)) {
+	case 0: return rnd(8);
+	case 1: return rnd(64);
+	case 2: return rnd(512);
+	default: return rnd(arena_size / 2);
+	}
+}
+
+/* A small alphabet so that searches hit, with bytes above 0x7F for the sign */
+static unsigned char rnd_char(void) {
+	static const unsigned char alphabet[] = "ab/.\x7f\x80\xff";
+	return alphabet[rnd(sizeof(alphabet) - 1)];
+}
+
+/* 'len' random non-zero bytes and a terminator at 'p' */
+static void fill_string(unsigned char *p, size_t len) {
+	for (size_t i = 0; i < len; i++)
+		p[i] = rnd_char();
+	p[len] = 0;
+}
+
+/* A string at a random alignment, or ending against the guard page */
+static unsigned char *place_string(size_t len) {
+	size_t at = rnd(2) ? arena_size - len - 1 : rnd(arena_size - len);
+	fill_string(arena + at, len);
+	return arena + at;
+}
+
+static int sign(int x) {
+	return (x > 0) - (x < 0);
+}
+
+static void fail(const char *func, const char *what, size_t a, size_t b) {
+	if (failures++ < 20)
+		printf("FAIL %s: %s (%zu, %zu)\n", func, what, a, b);
+}
+
+static void check_strlen(void) {
+	size_t len = rnd_len();
+	const char *s = (const char *) place_string(len);
+
+	if (k_strlen(s) != len)
+		fail("strlen", "length", k_strlen(s), len);
+}
+
+static void check_strchr(void) {
+	const char *s = (const char *) place_string(rnd_len());
+	int c = rnd(4) ? rnd_char() : rnd(2) ? 0 : 'z' | (int) rnd(2) << 8;
+
+	if (k_strchr(s, c) != strchr(s, c))
+		fail("strchr", "match", (size_t) (k_strchr(s, c) - s), (size_t) (strchr(s, c) - s));
+}
+
+static void check_memchr(void) {
+	size_t len = rnd_len();
+	unsigned char *p = place_string(len);
+	int c = rnd(4) ? rnd_char() : rnd(256);
+
+	len += rnd(2);                      /* the terminator is just a byte */
+	if (k_memchr(p, c, len) != memchr(p, c, len))
+		fail("memchr", "match", len, (size_t) c);
+}
+
+/* Two copies of one string, then one byte changed or the second cut short */
+static void make_pair(unsigned char **a, unsigned char **b, size_t *len) {
+	size_t half = arena_size / 2;
+
+	*len = rnd_len() / 2;
+	*a = place_string(*len);
+	if (*a < arena + half)
+		*a = arena + half + rnd(half - *len - 1);
+	fill_string(*a, *len);
+	*b = arena + rnd(half - *len - 1);
+	memcpy(*b, *a, *len + 1);
+
+	if (*len && rnd(3)) {
+		size_t at = rnd(*len);
+		(*b)[at] = rnd(4) ? rnd_char() : 0;
+	}
+	/* either one may be the string against the guard page */
+	if (rnd(2)) {
+		unsigned char *t = *a;
+		*a = *b;
+		*b = t;
+	}
+}
+
+static void check_memcmp(void) {
+	unsigned char *a, *b;
+	size_t len;
+
+	make_pair(&a, &b, &len);
+	if (sign(k_memcmp(a, b, len)) != sign(memcmp(a, b, len)))
+		fail("memcmp", "order", len, 0);
+}
+
+static void check_strncmp(void) {
+	unsigned char *a, *b;
+	size_t len;
+
+	make_pair(&a, &b, &len);
+	size_t n = rnd(2) ? len + 1 : rnd(len + 8);
+	if (sign(k_strncmp((char *) a, (char *) b, n)) != sign(strncmp((char *) a, (char *) b, n)))
+		fail("strncmp", "order", len, n);
+}
+
+/* GCC cannot tell the buffers are disjoint, they all come from the arena */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wrestrict"
+#endif
+
+/*
+ * The same call on the arena and on a copy of it, then the two compared
+ * whole: the result has to be right and nothing else may change.
+ */
+static void check_copy(int func) {
+	static const char *names[] = { "strcpy", "strncpy", "memcpy", "memmove", "memset" };
+	size_t len = rnd_len() / 2;
+	unsigned char *src = place_string(len);
+	size_t room = (size_t) (src - arena);
+	size_t n = rnd(len + 32);
+	size_t at;
+
+	if (func == 3) {
+		/* memmove: overlapping the source either way as often as not */
+		n = len;
+		at = rnd(2) ? rnd(arena_size - n) : room + rnd(2 * n + 1) - n;
+		if (at > arena_size - n)
+			at = arena_size - n;
+	} else {
+		/* the others take disjoint buffers, the destination goes below the source */
+		if (room < len + 40)
+			return;
+		at = rnd(room - len - 32);
+	}
+
+	unsigned char *dst = arena + at;
+	unsigned char *rdst = ref + at, *rsrc = ref + room;
+	int value = rnd(256);
+	void *got, *want;
+
+	memcpy(ref, arena, arena_size);
+	switch (func) {
+	case 0: got = k_strcpy((char *) dst, (char *) src); want = strcpy((char *) rdst, (char *) rsrc); break;
+	case 1: got = k_strncpy((char *) dst, (char *) src, n); want = strncpy((char *) rdst, (char *) rsrc, n); break;
+	case 2: got = k_memcpy(dst, src, len); want = memcpy(rdst, rsrc, len); break;
+	case 3: got = k_memmove(dst, src, n); want = memmove(rdst, rsrc, n); break;
+	default: got = k_memset(dst, value, n); want = memset(rdst, value, n); break;
+	}
+
+	if ((unsigned char *) got - arena != (unsigned char *) want - ref)
+		fail(names[func], "return value", len, n);
+	if (memcmp(arena, ref, arena_size))
+		fail(names[func], "contents", len, n);
+}
+
+int main(int argc, char **argv) {
+	unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 200000;
+	unsigned int seed = argc > 2 ? strtoul(argv[2], NULL, 0) : (unsigned int) time(NULL);
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	arena_size = ARENA_PAGES * page;
+	if (arena_size > sizeof(ref)) {
+		printf("string_fuzz: %zu byte pages are too large\n", page);
+		return 2;
+	}
+	arena = mmap(NULL, arena_size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (arena == MAP_FAILED || mprotect(arena + arena_size, page, PROT_NONE)) {
+		perror("string_fuzz: mmap");
+		return 2;
+	}
+
+	srandom(seed);
+	for (unsigned long i = 0; i < iterations; i++) {
+		switch (i % 10) {
+		case 0: check_strlen(); break;
+		case 1: check_strchr(); break;
+		case 2: check_memchr(); break;
+		case 3: check_memcmp(); break;
+		case 4: check_strncmp(); break;
+		default: check_copy(i % 10 - 5); break;
+		}
+	}
+
+	printf("string_fuzz: %lu cases, seed %u, %lu failures\n", iterations, seed, failures);
+	return failures != 0;
+}
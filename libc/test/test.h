@@ -0,0 +1,79 @@
+#ifndef _LIBC_TEST_TEST_H
+#define _LIBC_TEST_TEST_H
+
+/*
+ * Unit tests and micro-benchmarks for libk, run on the build machine.
+ *
+ *     TEST(snprintf_width) {
+ *         CHECK_STR(buf, "  42");
+ *     }
+ *
+ *     BENCH(strlen_4096) {
+ *         for (unsigned long i = 0; i < iterations; i++)
+ *             BENCH_KEEP(k_strlen(s));
+ *     }
+ *
+ * Both register themselves before main(). A failed CHECK reports where and
+ * carries on with the test. A benchmark runs 'iterations' operations per
+ * call; the runner picks the count so one sample takes a few milliseconds,
+ * then times a number of samples and reports ns/op.
+ */
+
+struct test {
+	const char *name;
+	void (*run)(void);
+	struct test *next;
+};
+
+struct bench {
+	const char *name;
+	void (*run)(unsigned long iterations);
+	struct bench *next;
+};
+
+void test_register(struct test *t);
+void bench_register(struct bench *b);
+
+void test_fail(const char *file, int line, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+#define TEST(name) \
+	static void test_##name(void); \
+	static struct test test_entry_##name = { #name, test_##name, 0 }; \
+	__attribute__((constructor)) static void test_add_##name(void) { \
+		test_register(&test_entry_##name); \
+	} \
+	static void test_##name(void)
+
+#define BENCH(name) \
+	static void bench_##name(unsigned long iterations); \
+	static struct bench bench_entry_##name = { #name, bench_##name, 0 }; \
+	__attribute__((constructor)) static void bench_add_##name(void) { \
+		bench_register(&bench_entry_##name); \
+	} \
+	static void bench_##name(unsigned long iterations)
+
+/* Make the compiler produce 'x' without letting it see what becomes of it */
+#define BENCH_KEEP(x) do { \
+	__typeof__(x) bench_value_ = (x); \
+	__asm__ __volatile__ ("" : : "g" (bench_value_) : "memory"); \
+} while (0)
+
+#define CHECK(cond) do { \
+	if (!(cond)) \
+		test_fail(__FILE__, __LINE__, "%s", #cond); \
+} while (0)
+
+#define CHECK_INT(got, want) do { \
+	long long got_ = (got), want_ = (want); \
+	if (got_ != want_) \
+		test_fail(__FILE__, __LINE__, "%s is %lld, not %lld", #got, got_, want_); \
+} while (0)
+
+#define CHECK_STR(got, want) do { \
+	const char *got_ = (got), *want_ = (want); \
+	if (strcmp(got_, want_)) \
+		test_fail(__FILE__, __LINE__, "%s is \"%s\", not \"%s\"", #got, got_, want_); \
+} while (0)
+
+#endif
@@ -0,0 +1,116 @@
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "klib.h"
+#include "test.h"
+
+/* Formats into buf and checks both the text and the returned length */
+#define CHECK_FORMAT(want, ...) do { \
+	char buf[128]; \
+	int n = k_snprintf(buf, sizeof(buf), __VA_ARGS__); \
+	CHECK_STR(buf, want); \
+	CHECK_INT(n, strlen(want)); \
+} while (0)
+
+/* ======== Tests ======== */
+
+TEST(printf_integers) {
+	CHECK_FORMAT("0", "%d", 0);
+	CHECK_FORMAT("-2147483648", "%d", INT_MIN);
+	CHECK_FORMAT("4294967295", "%u", 4294967295u);
+	CHECK_FORMAT("18446744073709551615", "%llu", 18446744073709551615ull);
+	CHECK_FORMAT("-9223372036854775808", "%lld", LLONG_MIN);
+	CHECK_FORMAT("1000000000", "%llu", 1000000000ull);
+	CHECK_FORMAT("deadbeef DEADBEEF 777", "%x %X %o", 0xdeadbeef, 0xdeadbeef, 0777);
+	CHECK_FORMAT("-1 255 65535", "%hhd %hhu %hu", 255, 255, 65535);
+}
+
+TEST(printf_flags) {
+	CHECK_FORMAT("[   42]", "[%5d]", 42);
+	CHECK_FORMAT("[42   ]", "[%-5d]", 42);
+	CHECK_FORMAT("[00042]", "[%05d]", 42);
+	CHECK_FORMAT("[-0042]", "[%05d]", -42);
+	CHECK_FORMAT("[+42] [ 42]", "[%+d] [% d]", 42, 42);
+	CHECK_FORMAT("[  007]", "[%5.3d]", 7);
+	CHECK_FORMAT("[]", "[%.0d]", 0);
+	CHECK_FORMAT("0x1f 0X1F 017", "%#x %#X %#o", 0x1f, 0x1f, 017);
+	CHECK_FORMAT("[0x0000ff]", "[%#08x]", 0xff);
+	CHECK_FORMAT("[    7]", "[%*d]", 5, 7);
+	CHECK_FORMAT("[7    ]", "[%*d]", -5, 7);
+}
+
+TEST(printf_strings) {
+	CHECK_FORMAT("hello", "%s", "hello");
+	CHECK_FORMAT("[  hi]", "[%4s]", "hi");
+	CHECK_FORMAT("[hi  ]", "[%-4s]", "hi");
+	CHECK_FORMAT("hel", "%.3s", "hello");
+	CHECK_FORMAT("(null)", "%s", (char *) NULL);
+	CHECK_FORMAT("x y", "%c %c", 'x', 'y');
+	CHECK_FORMAT("100%", "100%%");
+}
+
+TEST(snprintf_truncates) {
+	char buf[8];
+
+	memset(buf, 'x', sizeof(buf));
+	CHECK_INT(k_snprintf(buf, 5, "%s", "truncated"), 9);
+	CHECK_STR(buf, "trun");
+	CHECK_INT(buf[5], 'x');
+
+	/* with no room at all, nothing is written but the length is still counted */
+	CHECK_INT(k_snprintf(buf, 0, "%d", 12345), 5);
+	CHECK_INT(buf[0], 't');
+
+	CHECK_INT(k_snprintf(buf, 1, "abc"), 3);
+	CHECK_STR(buf, "");
+}
+
+TEST(sprintf_long_output) {
+	char buf[600], want[600];
+
+	/* longer than any internal buffer */
+	memset(want, ' ', 512);
+	want[512] = 0;
+	CHECK_INT(k_sprintf(buf, "%512s", ""), 512);
+	CHECK_STR(buf, want);
+}
+
+/* ======== Benchmarks ======== */
+
+static char out[128];
+
+BENCH(snprintf_u32) {
+	for (unsigned long i = 0; i < iterations; i++)
+		BENCH_KEEP(k_snprintf(out, sizeof(out), "%u", (unsigned int) i * 429497u));
+}
+
+BENCH(host_snprintf_u32) {
+	for (unsigned long i = 0; i < iterations; i++)
+		BENCH_KEEP(snprintf(out, sizeof(out), "%u", (unsigned int) i * 429497u));
+}
+
+BENCH(snprintf_u64) {
+	for (unsigned long i = 0; i < iterations; i++)
+		BENCH_KEEP(k_snprintf(out, sizeof(out), "%llu", 18446744073709ull * i));
+}
+
+BENCH(host_snprintf_u64) {
+	for (unsigned long i = 0; i < iterations; i++)
+		BENCH_KEEP(snprintf(out, sizeof(out), "%llu", 18446744073709ull * i));
+}
+
+/* a line as printk formats them */
+BENCH(snprintf_log_line) {
+	for (unsigned long i = 0; i < iterations; i++)
+		BENCH_KEEP(k_snprintf(out, sizeof(out), "irq %d: %u interrupts, %llu cycles each, %#010x %-8s|",
+				      (int) i & 15, (unsigned int) i * 7, 18446744073709ull * i,
+				      (unsigned int) i, "timer"));
+}
+
+BENCH(host_snprintf_log_line) {
+	for (unsigned long i = 0; i < iterations; i++)
+		BENCH_KEEP(snprintf(out, sizeof(out), "irq %d: %u interrupts, %llu cycles each, %#010x %-8s|",
+				    (int) i & 15, (unsigned int) i * 7, 18446744073709ull * i,
+				    (unsigned int) i, "timer"));
+}
@@ -0,0 +1,128 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "klib.h"
+#include "test.h"
+
+/* ======== Tests ======== */
+
+TEST(kmalloc_sizes) {
+	/* every size class, its edges, and large blocks */
+	static const size_t sizes[] = { 1, 15, 16, 17, 100, 1024, 4095, 4096, 4097, 20000, 100000 };
+	void *p[sizeof(sizes) / sizeof(sizes[0])];
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		p[i] = kmalloc(sizes[i]);
+		CHECK(p[i] != NULL);
+		CHECK_INT((uintptr_t) p[i] % 16, 0);
+		memset(p[i], (int) i, sizes[i]);
+	}
+	/* nothing overlapped: each block still holds its own pattern */
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		unsigned char *c = p[i];
+		CHECK_INT(c[0], i);
+		CHECK_INT(c[sizes[i] - 1], i);
+		kfree(p[i]);
+	}
+	CHECK(kmalloc(0) == NULL);
+	kfree(NULL);
+}
+
+TEST(kmalloc_large_returns_pages) {
+	long before = kpage_live;
+	void *p = kmalloc(64 * 1024);
+
+	CHECK(kpage_live > before);
+	kfree(p);
+	CHECK_INT(kpage_live, before);
+}
+
+static int ctor_runs;
+
+static void ctor(void *obj) {
+	ctor_runs++;
+	memset(obj, 0x5A, 48);
+}
+
+TEST(kmem_cache_constructs_once) {
+	struct kmem_cache *cache = kmem_cache_create("test-48", 48, 0, ctor);
+	CHECK(cache != NULL);
+	if (!cache)
+		return;
+
+	unsigned char *obj = kmem_cache_alloc(cache);
+	CHECK(obj != NULL);
+	CHECK_INT(ctor_runs, cache->per_slab);
+	CHECK_INT(obj[47], 0x5A);
+
+	/* objects come back constructed, the constructor does not run again */
+	obj[0] = 1;
+	kmem_cache_free(cache, obj);
+	unsigned char *again = kmem_cache_alloc(cache);
+	CHECK(again == obj);
+	CHECK_INT(again[0], 1);
+	CHECK_INT(ctor_runs, cache->per_slab);
+	kmem_cache_free(cache, again);
+}
+
+TEST(kmem_cache_shrink_frees_slabs) {
+	struct kmem_cache *cache = kmem_cache_create("test-200", 200, 64, NULL);
+	void *objs[200];
+	long before = kpage_live;
+
+	CHECK(cache != NULL);
+	if (!cache)
+		return;
+	for (int i = 0; i < 200; i++) {
+		objs[i] = kmem_cache_alloc(cache);
+		CHECK_INT((uintptr_t) objs[i] % 64, 0);
+	}
+	CHECK(cache->slabs > 1);
+	CHECK_INT(cache->live, 200);
+
+	for (int i = 0; i < 200; i++)
+		kmem_cache_free(cache, objs[i]);
+	kmem_cache_shrink(cache);
+	CHECK_INT(cache->slabs, 0);
+	CHECK_INT(kpage_live, before);
+}
+
+/* ======== Benchmarks ======== */
+
+BENCH(kmalloc_kfree_64) {
+	for (unsigned long i = 0; i < iterations; i++) {
+		void *p = kmalloc(64);
+		BENCH_KEEP(p);
+		kfree(p);
+	}
+}
+
+BENCH(host_malloc_free_64) {
+	for (unsigned long i = 0; i < iterations; i++) {
+		void *p = malloc(64);
+		BENCH_KEEP(p);
+		free(p);
+	}
+}
+
+/* a working set of 256 objects of mixed sizes, freed in a different order */
+BENCH(kmalloc_kfree_mixed) {
+	static void *live[256];
+
+	for (unsigned long i = 0; i < iterations; i++) {
+		unsigned int slot = (i * 97) & 255;
+		kfree(live[slot]);
+		live[slot] = kmalloc(16 << (i % 7));
+	}
+}
+
+BENCH(host_malloc_free_mixed) {
+	static void *live[256];
+
+	for (unsigned long i = 0; i < iterations; i++) {
+		unsigned int slot = (i * 97) & 255;
+		free(live[slot]);
+		live[slot] = malloc(16 << (i % 7));
+	}
+}
@@ -0,0 +1,165 @@
+#include <string.h>
+
+#include "klib.h"
+#include "test.h"
+
+/* ======== Tests ======== */
+
+TEST(strlen_alignments) {
+	char buf[64] __attribute__((aligned(16)));
+
+	/* every start and end offset around a word boundary */
+	memset(buf, 'x', sizeof(buf));
+	for (size_t start = 0; start < 16; start++) {
+		for (size_t len = 0; len < 40; len++) {
+			buf[start + len] = 0;
+			CHECK_INT(k_strlen(buf + start), len);
+			buf[start + len] = 'x';
+		}
+	}
+}
+
+TEST(strlen_high_bytes) {
+	/* 0x80 and 0x81 differ from a zero byte only by the borrow */
+	CHECK_INT(k_strlen("\x80\x80\x80\x80\x80\x80\x80\x80"), 8);
+	CHECK_INT(k_strlen("\x01\x81\x01\x81\x01\x81\x01\x81\x01"), 9);
+	CHECK_INT(k_strlen("\xff\xfe\xfd"), 3);
+}
+
+TEST(memcmp_order) {
+	CHECK_INT(k_memcmp("abc", "abc", 3), 0);
+	CHECK(k_memcmp("abcdefgh1", "abcdefgh2", 9) < 0);
+	CHECK(k_memcmp("abcdefgh2", "abcdefgh1", 9) > 0);
+	/* bytes compare unsigned */
+	CHECK(k_memcmp("\x80", "\x7f", 1) > 0);
+	CHECK(k_memcmp("aaaaaaaa\x01", "aaaaaaaa\xff", 9) < 0);
+	CHECK_INT(k_memcmp("x", "y", 0), 0);
+}
+
+TEST(strncmp_order) {
+	CHECK_INT(k_strncmp("abc", "abc", 10), 0);
+	CHECK_INT(k_strncmp("abcX", "abcY", 3), 0);
+	CHECK(k_strncmp("abc", "abd", 3) < 0);
+	CHECK(k_strncmp("abc", "ab", 3) > 0);
+	CHECK(k_strncmp("", "a", 1) < 0);
+	CHECK(k_strncmp("long string, same so far!", "long string, same so far?", 40) < 0);
+	CHECK(k_strncmp("\xff", "a", 1) > 0);
+	CHECK_INT(k_strncmp("a", "b", 0), 0);
+}
+
+TEST(strchr_finds) {
+	const char *s = "/usr/local/bin";
+
+	CHECK(k_strchr(s, '/') == s);
+	CHECK(k_strchr(s + 1, '/') == s + 4);
+	CHECK(k_strchr(s, 'n') == s + 13);
+	CHECK(k_strchr(s, 0) == s + 14);
+	CHECK(k_strchr(s, 'z') == NULL);
+	/* the argument is converted to char */
+	CHECK(k_strchr(s, 'l' | 0x100) == s + 5);
+}
+
+TEST(memchr_finds) {
+	const char buf[] = "abc\0def\0\xff";
+
+	CHECK(k_memchr(buf, 'd', sizeof(buf)) == buf + 4);
+	CHECK(k_memchr(buf, 0, sizeof(buf)) == buf + 3);
+	CHECK(k_memchr(buf, 0xff, sizeof(buf)) == buf + 8);
+	CHECK(k_memchr(buf, 'd', 4) == NULL);
+	CHECK(k_memchr(buf, 'a', 0) == NULL);
+}
+
+TEST(strcpy_terminates) {
+	char buf[32];
+
+	memset(buf, 'x', sizeof(buf));
+	CHECK(k_strcpy(buf + 1, "hello, world") == buf + 1);
+	CHECK_STR(buf + 1, "hello, world");
+	CHECK_INT(buf[14], 'x');
+	CHECK_STR(k_strcpy(buf, ""), "");
+}
+
+TEST(strncpy_pads) {
+	char buf[16];
+
+	memset(buf, 'x', sizeof(buf));
+	k_strncpy(buf, "abc", 8);
+	CHECK_INT(k_memcmp(buf, "abc\0\0\0\0\0xx", 10), 0);
+
+	/* no room for the terminator, none is written */
+	memset(buf, 'x', sizeof(buf));
+	k_strncpy(buf, "abcdefghijkl", 5);
+	CHECK_INT(k_memcmp(buf, "abcdex", 6), 0);
+}
+
+TEST(memmove_overlap) {
+	char buf[64];
+
+	for (int i = 0; i < 64; i++)
+		buf[i] = i;
+	k_memmove(buf + 3, buf, 40);
+	for (int i = 0; i < 40; i++)
+		CHECK_INT(buf[i + 3], i);
+
+	for (int i = 0; i < 64; i++)
+		buf[i] = i;
+	k_memmove(buf, buf + 5, 40);
+	for (int i = 0; i < 40; i++)
+		CHECK_INT(buf[i], i + 5);
+}
+
+TEST(memset_fills) {
+	unsigned char buf[100];
+
+	memset(buf, 0, sizeof(buf));
+	CHECK(k_memset(buf + 1, 0x1A5, 90) == buf + 1);
+	CHECK_INT(buf[0], 0);
+	for (int i = 1; i < 91; i++)
+		CHECK_INT(buf[i], 0xA5);
+	CHECK_INT(buf[91], 0);
+}
+
+/* ======== Benchmarks ======== */
+
+#define STRING_MAX 4096
+
+/* every length ends at the same terminator, one byte off alignment in both rows */
+static char text[2][STRING_MAX + 16] __attribute__((aligned(16)));
+static char copy[STRING_MAX + 16];
+
+__attribute__((constructor)) static void text_init(void) {
+	memset(text, 'a', sizeof(text));
+	text[0][STRING_MAX + 1] = text[1][STRING_MAX + 1] = 0;
+}
+
+#define STR(n, len) (text[n] + STRING_MAX + 1 - (len))
+
+#define STRING_BENCH(name, len, call) \
+	BENCH(name##_##len) { \
+		const char *a = STR(0, len), *b = STR(1, len); \
+		(void) a; (void) b; \
+		for (unsigned long i = 0; i < iterations; i++) \
+			BENCH_KEEP(call); \
+	}
+
+/* libk and the host C library side by side, at a short and a long length */
+#define STRING_BENCHES(len) \
+	STRING_BENCH(strlen, len, k_strlen(a)) \
+	STRING_BENCH(host_strlen, len, strlen(a)) \
+	STRING_BENCH(memcmp, len, k_memcmp(a, b, len)) \
+	STRING_BENCH(host_memcmp, len, memcmp(a, b, len)) \
+	STRING_BENCH(strncmp, len, k_strncmp(a, b, len + 1)) \
+	STRING_BENCH(host_strncmp, len, strncmp(a, b, len + 1)) \
+	STRING_BENCH(strchr, len, k_strchr(a, '/')) \
+	STRING_BENCH(host_strchr, len, strchr(a, '/')) \
+	STRING_BENCH(memchr, len, k_memchr(a, '/', len)) \
+	STRING_BENCH(host_memchr, len, memchr(a, '/', len)) \
+	STRING_BENCH(strcpy, len, k_strcpy(copy + 1, a)) \
+	STRING_BENCH(host_strcpy, len, strcpy(copy + 1, a)) \
+	STRING_BENCH(memcpy, len, k_memcpy(copy + 1, a, len)) \
+	STRING_BENCH(host_memcpy, len, memcpy(copy + 1, a, len)) \
+	STRING_BENCH(memset, len, k_memset(copy + 1, 0, len)) \
+	STRING_BENCH(host_memset, len, memset(copy + 1, 0, len))
+
+STRING_BENCHES(16)
+STRING_BENCHES(4096)
@@ -0,0 +1,8 @@
+#include <sys/syscall.h>
+#include <unistd.h>
+
+__attribute__((__noreturn__))
+void _exit(int status) {
+	syscall(SYS_exit, status, 0, 0);
+	__builtin_unreachable();
+}